@@ -0,0 +1,186 @@
+/*
+ * Drawy - A simple brainstorming tool with an infinite canvas
+ * Copyright (C) 2025 - Prayag Jain <prayagjain2@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "boardgenerator.hpp"
+
+#include <cmath>
+#include <numbers>
+
+#include "../src/item/freeform.hpp"
+#include "../src/item/item.hpp"
+#include "../src/item/rectangle.hpp"
+#include "../src/item/text.hpp"
+
+namespace {
+// average world area reserved for a single item, keeps density constant across sizes
+constexpr double areaPerItem{60.0 * 60.0};
+constexpr int itemsPerCluster{2000};
+constexpr double clusterSpread{400.0};
+constexpr double stackSpread{5.0};
+constexpr int itemsPerFrame{50};
+constexpr int itemPadding{10};
+
+const QVector<QString> words{"idea",   "todo",  "draft",    "note", "plan",
+                             "review", "later", "question", "why",  "ship"};
+}  // namespace
+
+BoardGenerator::BoardGenerator(quint32 seed) : m_engine{seed} {
+}
+
+QString BoardGenerator::name(Layout layout, Mix mix) {
+    QString layoutName{};
+    switch (layout) {
+        case Uniform:
+            layoutName = "uniform";
+            break;
+        case Clustered:
+            layoutName = "clustered";
+            break;
+        case Large:
+            layoutName = "large";
+            break;
+        default:
+            layoutName = "stacked";
+    }
+
+    switch (mix) {
+        case Strokes:
+            return layoutName + "-strokes";
+        case Rectangles:
+            return layoutName + "-rectangles";
+        case Text:
+            return layoutName + "-text";
+        default:
+            return layoutName + "-mixed";
+    }
+}
+
+BoardGenerator::Board BoardGenerator::generate(Layout layout, Mix mix, int count) {
+    Board board{};
+    board.name = name(layout, mix);
+
+    double side{std::sqrt(count * areaPerItem)};
+    board.bounds = QRectF{0, 0, side, side};
+
+    QVector<QPointF> clusters{};
+    if (layout == Clustered || layout == Stacked) {
+        int clusterCount{std::max(1, count / itemsPerCluster)};
+        for (int i{0}; i < clusterCount; i++) {
+            clusters.push_back(QPointF{uniform(0, side), uniform(0, side)});
+        }
+    }
+
+    std::normal_distribution<double> spread{0, layout == Stacked ? stackSpread : clusterSpread};
+    int lastCluster{std::max(0, static_cast<int>(clusters.size()) - 1)};
+    std::uniform_int_distribution<int> clusterIndex{0, lastCluster};
+    std::uniform_int_distribution<int> kind{0, 2};
+
+    board.items.reserve(count);
+    for (int i{0}; i < count; i++) {
+        QPointF origin{};
+        if (layout == Uniform || layout == Large) {
+            origin = QPointF{uniform(0, side), uniform(0, side)};
+        } else {
+            const QPointF &center{clusters[clusterIndex(m_engine)]};
+            origin = center + QPointF{spread(m_engine), spread(m_engine)};
+        }
+
+        if (layout == Large && i % itemsPerFrame == 0) {
+            board.items.push_back(createFrame(origin, side));
+            continue;
+        }
+
+        Mix itemMix{mix == Mixed ? static_cast<Mix>(kind(m_engine)) : mix};
+        switch (itemMix) {
+            case Strokes:
+                board.items.push_back(createStroke(origin));
+                break;
+            case Rectangles:
+                board.items.push_back(createRectangle(origin));
+                break;
+            default:
+                board.items.push_back(createText(origin));
+        }
+    }
+
+    return board;
+}
+
+std::shared_ptr<Item> BoardGenerator::createStroke(const QPointF &origin) {
+    std::shared_ptr<FreeformItem> stroke{std::make_shared<FreeformItem>()};
+    stroke->setBoundingBoxPadding(itemPadding);
+
+    // a random walk with some momentum looks close enough to handwriting
+    int pointCount{static_cast<int>(uniform(8, 40))};
+    double angle{uniform(0, 2 * std::numbers::pi)};
+    QPointF point{origin};
+
+    for (int i{0}; i < pointCount; i++) {
+        stroke->addPoint(point, uniform(0.5, 1.0), false);
+
+        angle += uniform(-0.6, 0.6);
+        point += QPointF{std::cos(angle), std::sin(angle)} * uniform(4, 12);
+    }
+
+    return stroke;
+}
+
+std::shared_ptr<Item> BoardGenerator::createRectangle(const QPointF &origin) {
+    std::shared_ptr<RectangleItem> rectangle{std::make_shared<RectangleItem>()};
+    rectangle->setBoundingBoxPadding(itemPadding);
+
+    rectangle->setStart(origin);
+    rectangle->setEnd(origin + QPointF{uniform(20, 300), uniform(20, 200)});
+
+    return rectangle;
+}
+
+std::shared_ptr<Item> BoardGenerator::createFrame(const QPointF &origin, double side) {
+    std::shared_ptr<RectangleItem> frame{std::make_shared<RectangleItem>()};
+    frame->setBoundingBoxPadding(itemPadding);
+
+    // from a screen up to half of the board, so some of them cover whole quadtree tiles
+    double width{uniform(2000, std::max(2000.0, side / 2))};
+    double height{uniform(1000, std::max(1000.0, side / 2))};
+    frame->setStart(origin);
+    frame->setEnd(origin + QPointF{width, height});
+
+    return frame;
+}
+
+std::shared_ptr<Item> BoardGenerator::createText(const QPointF &origin) {
+    std::shared_ptr<TextItem> text{std::make_shared<TextItem>()};
+    text->setBoundingBoxPadding(itemPadding);
+
+    std::uniform_int_distribution<int> wordIndex{0, static_cast<int>(words.size()) - 1};
+    int wordCount{static_cast<int>(uniform(1, 6))};
+
+    QString content{};
+    for (int i{0}; i < wordCount; i++) {
+        content = content + words[wordIndex(m_engine)] + " ";
+    }
+
+    text->createTextBox(origin);
+    text->insertText(content);
+
+    return text;
+}
+
+double BoardGenerator::uniform(double min, double max) {
+    return std::uniform_real_distribution<double>{min, max}(m_engine);
+}
@@ -0,0 +1,61 @@
+/*
+ * Drawy - A simple brainstorming tool with an infinite canvas
+ * Copyright (C) 2025 - Prayag Jain <prayagjain2@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QRectF>
+#include <QString>
+#include <QVector>
+#include <memory>
+#include <random>
+
+class Item;
+
+/*
+ * Generates synthetic boards for the benchmarks. The same seed always produces
+ * the same board, so numbers from different builds can be compared directly.
+ */
+class BoardGenerator {
+public:
+    // Large spreads the items like Uniform, with every so often a frame spanning a good part
+    // of the board; Stacked piles them up on a few spots, like pasting the same items again
+    enum Layout { Uniform, Clustered, Large, Stacked };
+    enum Mix { Strokes, Rectangles, Text, Mixed };
+
+    struct Board {
+        QString name{};
+        QRectF bounds{};
+        QVector<std::shared_ptr<Item>> items{};
+    };
+
+    BoardGenerator(quint32 seed);
+
+    Board generate(Layout layout, Mix mix, int count);
+
+    static QString name(Layout layout, Mix mix);
+
+private:
+    std::mt19937 m_engine;
+
+    std::shared_ptr<Item> createStroke(const QPointF &origin);
+    std::shared_ptr<Item> createRectangle(const QPointF &origin);
+    std::shared_ptr<Item> createText(const QPointF &origin);
+    std::shared_ptr<Item> createFrame(const QPointF &origin, double side);
+
+    double uniform(double min, double max);
+};
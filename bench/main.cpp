@@ -0,0 +1,579 @@
+/*
+ * Drawy - A simple brainstorming tool with an infinite canvas
+ * Copyright (C) 2025 - Prayag Jain <prayagjain2@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGuiApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <random>
+
+#include "../src/data-structures/cachegrid.hpp"
+#include "../src/data-structures/orderedlist.hpp"
+#include "../src/data-structures/spatialindex.hpp"
+#include "../src/item/item.hpp"
+#include "boardgenerator.hpp"
+
+/*
+ * drawy_bench times the spatial data structures on synthetic boards and prints
+ * the results as JSON, so that numbers from different builds can be compared.
+ */
+
+namespace {
+// keep these in sync with RenderingContext
+constexpr QSize viewportSize{1920, 1080};
+
+// the names accepted by SpatialIndex::create
+const QStringList spatialIndexes{"quadtree-split", "quadtree", "rtree", "grid"};
+
+constexpr QSizeF eraserSize{30, 30};
+constexpr int selectionSize{64};
+
+struct Options {
+    int items{};
+    int iterations{};
+    quint32 seed{};
+    QString board{};
+    QStringList indexes{};
+    QVector<int> capacities{};  // 0 runs the index with its default capacity
+    SpatialIndex::Settings settings{};
+    QString output{};
+};
+
+template <typename Function>
+qint64 measure(Function function) {
+    QElapsedTimer timer{};
+    timer.start();
+    function();
+    return timer.nsecsElapsed();
+}
+
+QJsonObject record(const QString &board,
+                   const QString &structure,
+                   const QString &operation,
+                   qint64 count,
+                   qint64 nanoseconds) {
+    QJsonObject result{};
+    result["board"] = board;
+    result["structure"] = structure;
+    result["operation"] = operation;
+    result["count"] = count;
+    result["total_ms"] = nanoseconds / 1e6;
+    result["ns_per_op"] = count > 0 ? static_cast<double>(nanoseconds) / count : 0.0;
+    return result;
+}
+
+QPointF randomPoint(const QRectF &bounds, std::mt19937 &engine) {
+    std::uniform_real_distribution<double> x{bounds.left(), bounds.right()};
+    std::uniform_real_distribution<double> y{bounds.top(), bounds.bottom()};
+    return {x(engine), y(engine)};
+}
+
+QVector<int> randomIndices(int size, int count, std::mt19937 &engine) {
+    QVector<int> indices(size);
+    std::iota(indices.begin(), indices.end(), 0);
+    std::shuffle(indices.begin(), indices.end(), engine);
+    indices.resize(std::min(size, count));
+    return indices;
+}
+
+// the work the index did for the queries since the last call
+void addQueryCost(QJsonObject &result, SpatialIndex &spatialIndex) {
+    const SpatialIndex::QueryCost &cost{spatialIndex.queryCost()};
+    double queries{static_cast<double>(std::max<qint64>(cost.queries, 1))};
+
+    result["mean_nodes_visited"] = cost.nodesVisited / queries;
+    result["mean_candidates_tested"] = cost.candidatesTested / queries;
+    result["mean_items_tested"] = cost.itemsTested / queries;
+    spatialIndex.resetQueryCost();
+}
+
+void benchmarkSpatialIndex(const BoardGenerator::Board &board,
+                           const QString &name,
+                           const SpatialIndex::Settings &settings,
+                           const std::shared_ptr<OrderedList> &orderedList,
+                           const Options &options,
+                           QJsonArray &results) {
+    // every index gets the same queries and moves, whatever ran before it
+    std::mt19937 engine{options.seed};
+
+    // the items can only be in one ordered list, which the runs on a board take over
+    orderedList->clear();
+    std::unique_ptr<SpatialIndex> index{SpatialIndex::create(name, orderedList, settings)};
+    SpatialIndex &spatialIndex{*index};
+
+    QString structure{spatialIndex.name()};
+    if (settings.capacity > 0) {
+        structure += QString{" capacity=%1"}.arg(settings.capacity);
+    }
+
+    qint64 elapsed{measure([&]() {
+        for (const auto &item : board.items) {
+            spatialIndex.insertItem(item);
+        }
+    })};
+    results.push_back(record(board.name, structure, "insertItem", board.items.size(), elapsed));
+
+    SpatialIndex::Stats stats{spatialIndex.stats()};
+    QJsonObject layout{record(board.name, structure, "layout", stats.items, 0)};
+    layout["nodes"] = stats.nodes;
+    layout["leaves"] = stats.leaves;
+    layout["max_depth"] = stats.maxDepth;
+    layout["mean_depth"] = stats.meanDepth;
+    layout["duplication"] = stats.duplication();
+
+    QJsonArray occupancy{};
+    for (int leaves : stats.occupancy) {
+        occupancy.push_back(leaves);
+    }
+    layout["leaf_occupancy"] = occupancy;
+    results.push_back(layout);
+
+    // opening a file, which puts the items back into the list in the same order
+    {
+        std::unique_ptr<SpatialIndex> packed{SpatialIndex::create(name, orderedList, settings)};
+        elapsed = measure([&]() { packed->bulkLoad(board.items); });
+        results.push_back(record(board.name, structure, "bulkLoad", board.items.size(), elapsed));
+    }
+
+    // a dirty cache cell, as queried by renderCanvas
+    QVector<QRectF> tiles{};
+    for (int i{0}; i < options.iterations; i++) {
+        tiles.push_back(QRectF{randomPoint(board.bounds, engine), CacheCell::cellSize().toSizeF()});
+    }
+
+    qint64 hits{0};
+    elapsed = measure([&]() {
+        for (const QRectF &tile : tiles) {
+            hits += spatialIndex.queryItems(tile, [](auto item, auto &shape) { return true; }).size();
+        }
+    });
+
+    QJsonObject result{record(board.name, structure, "queryItems(tile)", tiles.size(), elapsed)};
+    result["mean_results"] = static_cast<double>(hits) / tiles.size();
+    addQueryCost(result, spatialIndex);
+    results.push_back(result);
+
+    // the eraser runs the exact item intersection test on a small box
+    QVector<QRectF> erasers{};
+    for (int i{0}; i < options.iterations; i++) {
+        erasers.push_back(QRectF{randomPoint(board.bounds, engine), eraserSize});
+    }
+
+    hits = 0;
+    elapsed = measure([&]() {
+        for (const QRectF &eraser : erasers) {
+            hits += spatialIndex.queryItems(eraser).size();
+        }
+    });
+
+    result = record(board.name, structure, "queryItems(eraser)", erasers.size(), elapsed);
+    result["mean_results"] = static_cast<double>(hits) / erasers.size();
+    addQueryCost(result, spatialIndex);
+    results.push_back(result);
+
+    // the text tool looks for a text box under the cursor on every mouse move
+    QVector<QPointF> cursors{};
+    for (int i{0}; i < options.iterations; i++) {
+        cursors.push_back(randomPoint(board.bounds, engine));
+    }
+
+    hits = 0;
+    elapsed = measure([&]() {
+        for (const QPointF &cursor : cursors) {
+            hits += spatialIndex
+                        .queryItems(cursor,
+                                    [](std::shared_ptr<Item> item, const QPointF &point) {
+                                        return item->type() == Item::Text &&
+                                               item->boundingBox().contains(point);
+                                    })
+                        .size();
+        }
+    });
+
+    result = record(board.name, structure, "queryItems(hover)", cursors.size(), elapsed);
+    result["mean_results"] = static_cast<double>(hits) / cursors.size();
+    addQueryCost(result, spatialIndex);
+    results.push_back(result);
+
+    // the same two, streaming the items instead of collecting them, the way the canvas
+    // and the tools query the tree
+    hits = 0;
+    elapsed = measure([&]() {
+        for (const QRectF &tile : tiles) {
+            spatialIndex.visitItems(
+                tile,
+                [](const auto &, const auto &) { return true; },
+                [&](const auto &) { hits++; });
+        }
+    });
+
+    result = record(board.name, structure, "visitItems(tile)", tiles.size(), elapsed);
+    result["mean_results"] = static_cast<double>(hits) / tiles.size();
+    addQueryCost(result, spatialIndex);
+    results.push_back(result);
+
+    hits = 0;
+    elapsed = measure([&]() {
+        for (const QPointF &cursor : cursors) {
+            spatialIndex.visitItems(
+                cursor,
+                [](const std::shared_ptr<Item> &item, const QPointF &point) {
+                    return item->type() == Item::Text && item->boundingBox().contains(point);
+                },
+                [&](const auto &) {
+                    hits++;
+                    return false;
+                },
+                SpatialIndex::Order::FrontToBack);
+        }
+    });
+
+    result = record(board.name, structure, "visitItems(hover)", cursors.size(), elapsed);
+    result["mean_results"] = static_cast<double>(hits) / cursors.size();
+    addQueryCost(result, spatialIndex);
+    results.push_back(result);
+
+    hits = 0;
+    elapsed = measure([&]() {
+        for (const QPointF &cursor : cursors) {
+            hits += spatialIndex.topmostItemAt(cursor, 0, Item::Text) != nullptr;
+        }
+    });
+
+    result = record(board.name, structure, "topmostItemAt(hover)", cursors.size(), elapsed);
+    result["mean_results"] = static_cast<double>(hits) / cursors.size();
+    addQueryCost(result, spatialIndex);
+    results.push_back(result);
+
+    // small moves, like dragging a selection around
+    QVector<int> moved{randomIndices(board.items.size(), options.iterations, engine)};
+    std::uniform_real_distribution<double> delta{-50, 50};
+
+    QVector<QPointF> moves{};
+    moves.reserve(moved.size());
+    for (qsizetype i{0}; i < moved.size(); i++) {
+        moves.push_back(QPointF{delta(engine), delta(engine)});
+    }
+
+    elapsed = measure([&]() {
+        for (qsizetype i{0}; i < moved.size(); i++) {
+            const auto &item{board.items[moved[i]]};
+
+            item->translate(moves[i]);
+            spatialIndex.updateItem(item);
+        }
+    });
+    results.push_back(record(board.name, structure, "updateItem", moved.size(), elapsed));
+
+    QVector<int> deleted{randomIndices(board.items.size(), options.iterations, engine)};
+    elapsed = measure([&]() {
+        for (int index : deleted) {
+            spatialIndex.deleteItem(board.items[index]);
+        }
+    });
+    results.push_back(record(board.name, structure, "deleteItem", deleted.size(), elapsed));
+
+    // the board is shared with the runs after this one, so the moves are undone backwards
+    for (qsizetype i{moved.size() - 1}; i >= 0; i--) {
+        board.items[moved[i]]->translate(-moves[i]);
+    }
+}
+
+void benchmarkOrderedList(const BoardGenerator::Board &board,
+                          OrderedList &orderedList,
+                          const Options &options,
+                          QJsonArray &results) {
+    std::mt19937 engine{options.seed};
+    orderedList.clear();
+
+    qint64 elapsed{measure([&]() {
+        for (const auto &item : board.items) {
+            orderedList.insert(item);
+        }
+    })};
+    results.push_back(record(board.name, "OrderedList", "insert", board.items.size(), elapsed));
+
+    std::uniform_int_distribution<int> index{0, static_cast<int>(board.items.size()) - 1};
+    QVector<int> targets{};
+    for (int i{0}; i < options.iterations; i++) {
+        targets.push_back(index(engine));
+    }
+
+    auto run = [&](const QString &operation, auto function) {
+        qint64 nanoseconds{measure([&]() {
+            for (int target : targets) {
+                function(board.items[target]);
+            }
+        })};
+        results.push_back(
+            record(board.name, "OrderedList", operation, targets.size(), nanoseconds));
+    };
+
+    run("bringForward", [&](const auto &item) { orderedList.bringForward(item); });
+    run("sendBackward", [&](const auto &item) { orderedList.sendBackward(item); });
+    run("bringToFront", [&](const auto &item) { orderedList.bringToFront(item); });
+    run("sendToBack", [&](const auto &item) { orderedList.sendToBack(item); });
+
+    // whole selections, as done by the z-order actions and when grouping
+    QVector<QVector<std::shared_ptr<Item>>> selections{};
+    for (int i{0}; i < std::max(1, options.iterations / selectionSize); i++) {
+        QVector<std::shared_ptr<Item>> selection{};
+        for (int target : randomIndices(board.items.size(), selectionSize, engine)) {
+            selection.push_back(board.items[target]);
+        }
+        selections.push_back(selection);
+    }
+
+    auto runSelections = [&](const QString &operation, auto function) {
+        qint64 nanoseconds{measure([&]() {
+            for (const auto &selection : selections) {
+                function(selection);
+            }
+        })};
+        results.push_back(record(board.name,
+                                 "OrderedList",
+                                 operation,
+                                 selections.size() * selectionSize,
+                                 nanoseconds));
+    };
+
+    runSelections("bringForward(selection)",
+                  [&](const auto &selection) { orderedList.bringForward(selection); });
+    runSelections("bringToFront(selection)",
+                  [&](const auto &selection) { orderedList.bringToFront(selection); });
+    runSelections("sendToBack(selection)",
+                  [&](const auto &selection) { orderedList.sendToBack(selection); });
+    runSelections("insertBlock", [&](const auto &selection) {
+        orderedList.insertBlock(selection, board.items[index(engine)]);
+    });
+
+    qint64 checksum{0};
+    run("zIndex", [&](const auto &item) { checksum += orderedList.zIndex(item); });
+
+    QVector<int> removed{randomIndices(board.items.size(), options.iterations, engine)};
+    elapsed = measure([&]() {
+        for (int target : removed) {
+            orderedList.remove(board.items[target]);
+        }
+    });
+    results.push_back(record(board.name, "OrderedList", "remove", removed.size(), elapsed));
+}
+
+void benchmarkCacheGrid(const Options &options, QJsonArray &results) {
+    std::mt19937 engine{options.seed};
+    // same budget as RenderingContext::canvasResized for a full HD canvas
+    int cellW{CacheCell::cellSize().width()}, cellH{CacheCell::cellSize().height()};
+    int rows{static_cast<int>(std::ceil(viewportSize.height() / static_cast<double>(cellH)) + 1)};
+    int cols{static_cast<int>(std::ceil(viewportSize.width() / static_cast<double>(cellW)) + 1)};
+    qsizetype budget{std::min(9 * rows * cols * CacheCell::imageBytes(),
+                              CacheGrid::budgetFromEnvironment())};
+    int capacity{static_cast<int>(budget / CacheCell::imageBytes())};
+
+    // panning: the viewport drifts in one direction and turns every now and then
+    {
+        CacheGrid cacheGrid{budget};
+        std::uniform_real_distribution<double> turn{-0.5, 0.5};
+        double angle{0};
+        QPointF position{0, 0};
+        qint64 cells{0};
+
+        qint64 elapsed{measure([&]() {
+            for (int frame{0}; frame < options.iterations; frame++) {
+                angle += turn(engine);
+                position += QPointF{std::cos(angle), std::sin(angle)} * 40;
+
+                QRect viewport{position.toPoint(), viewportSize};
+                cells += cacheGrid.queryCells(0, viewport).size();
+            }
+        })};
+
+        QJsonObject result{
+            record("synthetic", "CacheGrid", "queryCells(pan)", options.iterations, elapsed)};
+        result["capacity"] = capacity;
+        result["budget"] = budget;
+        result["mean_results"] = static_cast<double>(cells) / options.iterations;
+        results.push_back(result);
+    }
+
+    // random access over an area much larger than the cache, every miss renders into the
+    // image of the least recently used cell
+    {
+        CacheGrid cacheGrid{budget};
+        std::uniform_int_distribution<int> coordinate{-4 * cols, 4 * cols};
+
+        QVector<QPoint> points{};
+        for (int i{0}; i < options.iterations; i++) {
+            points.push_back(QPoint{coordinate(engine), coordinate(engine)});
+        }
+
+        qint64 elapsed{measure([&]() {
+            for (const QPoint &point : points) {
+                std::shared_ptr<CacheCell> cell{cacheGrid.cell(0, point)};
+                if (cell->image().isNull()) {
+                    cacheGrid.storeImage(*cell, cacheGrid.acquireImage(*cell));
+                }
+            }
+        })};
+
+        QJsonObject result{record("synthetic", "CacheGrid", "cell(churn)", points.size(), elapsed)};
+        result["capacity"] = capacity;
+        result["budget"] = budget;
+        results.push_back(result);
+    }
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    // cache cells need a QGuiApplication for their pixmaps, but never a window
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QGuiApplication app{argc, argv};
+    QCoreApplication::setApplicationName("drawy_bench");
+
+    // items and data structures print a debug line for every insertion and deletion
+    QLoggingCategory::setFilterRules("*.debug=false");
+
+    QCommandLineParser parser{};
+    parser.setApplicationDescription("Benchmarks Drawy's spatial data structures");
+    parser.addHelpOption();
+
+    QCommandLineOption itemsOption{"items", "Number of items per board.", "count", "200000"};
+    QCommandLineOption iterationsOption{"iterations",
+                                        "Number of queries, updates and deletions per benchmark.",
+                                        "count",
+                                        "10000"};
+    QCommandLineOption seedOption{"seed", "Seed for the board generator.", "seed", "42"};
+    QCommandLineOption boardOption{"board",
+                                   "Only run boards whose name contains this text.",
+                                   "name"};
+    QCommandLineOption indexOption{"index",
+                                   "Only run these spatial indexes (comma separated), out of " +
+                                       spatialIndexes.join(", ") + ".",
+                                   "names",
+                                   spatialIndexes.join(",")};
+    QCommandLineOption capacityOption{
+        "capacity",
+        "Run every index with each of these node capacities (comma separated).",
+        "counts"};
+    QCommandLineOption minNodeSizeOption{
+        "min-node-size", "Smallest quadtree node which may be split, in world units.", "size"};
+    QCommandLineOption cellSizeOption{"cell-size", "Cell size of the grid, in world units.", "size"};
+    QCommandLineOption outputOption{"output", "Write the JSON report to this file.", "file"};
+
+    parser.addOptions({itemsOption,
+                       iterationsOption,
+                       seedOption,
+                       boardOption,
+                       indexOption,
+                       capacityOption,
+                       minNodeSizeOption,
+                       cellSizeOption,
+                       outputOption});
+    parser.process(app);
+
+    Options options{};
+    options.items = std::max(1, parser.value(itemsOption).toInt());
+    options.iterations = std::max(1, parser.value(iterationsOption).toInt());
+    options.seed = parser.value(seedOption).toUInt();
+    options.board = parser.value(boardOption);
+    options.indexes = parser.value(indexOption).split(',', Qt::SkipEmptyParts);
+    options.settings.minNodeSize = parser.value(minNodeSizeOption).toDouble();
+    options.settings.cellSize = parser.value(cellSizeOption).toDouble();
+
+    for (const QString &capacity : parser.value(capacityOption).split(',', Qt::SkipEmptyParts)) {
+        options.capacities.push_back(std::max(1, capacity.toInt()));
+    }
+    if (options.capacities.isEmpty()) {
+        options.capacities.push_back(0);
+    }
+    options.output = parser.value(outputOption);
+
+    QJsonArray results{};
+
+    for (auto layout : {BoardGenerator::Uniform,
+                        BoardGenerator::Clustered,
+                        BoardGenerator::Large,
+                        BoardGenerator::Stacked}) {
+        for (auto mix : {BoardGenerator::Strokes,
+                         BoardGenerator::Rectangles,
+                         BoardGenerator::Text,
+                         BoardGenerator::Mixed}) {
+            QString name{BoardGenerator::name(layout, mix)};
+            if (!options.board.isEmpty() && !name.contains(options.board)) {
+                continue;
+            }
+
+            qInfo() << "Running board" << name;
+
+            BoardGenerator generator{options.seed};
+            BoardGenerator::Board board{generator.generate(layout, mix, options.items)};
+            std::shared_ptr<OrderedList> orderedList{std::make_shared<OrderedList>()};
+
+            for (const QString &index : options.indexes) {
+                for (int capacity : options.capacities) {
+                    SpatialIndex::Settings settings{options.settings};
+                    settings.capacity = capacity;
+                    benchmarkSpatialIndex(board, index, settings, orderedList, options, results);
+                }
+            }
+            benchmarkOrderedList(board, *orderedList, options, results);
+        }
+    }
+
+    qInfo() << "Running cache grid";
+    benchmarkCacheGrid(options, results);
+
+    QJsonObject report{};
+    report["benchmark"] = "drawy_bench";
+    report["qt_version"] = qVersion();
+    report["build_type"] = DRAWY_BENCH_BUILD_TYPE;
+    report["items"] = options.items;
+    report["iterations"] = options.iterations;
+    report["seed"] = static_cast<qint64>(options.seed);
+    report["results"] = results;
+
+    QByteArray json{QJsonDocument{report}.toJson(QJsonDocument::Indented)};
+
+    QFile file{};
+    bool opened{false};
+    if (options.output.isEmpty()) {
+        opened = file.open(stdout, QIODevice::WriteOnly);
+    } else {
+        file.setFileName(options.output);
+        opened = file.open(QIODevice::WriteOnly);
+    }
+
+    if (!opened) {
+        qWarning() << "Failed to open output:" << file.errorString();
+        return 1;
+    }
+
+    file.write(json);
+    file.close();
+
+    return 0;
+}
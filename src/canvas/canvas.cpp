@@ -19,6 +19,7 @@
 #include "canvas.hpp"
 
 #include <QBuffer>
+#include <QPaintEvent>
 #include <QResizeEvent>
 #include <QScreen>
 
@@ -103,12 +104,19 @@ QSize Canvas::dimensions() const {
 void Canvas::paintEvent(QPaintEvent *event) {
     QPainter painter{this};
     painter.scale(1.0 / m_scale, 1.0 / m_scale);
-    painter.setClipRegion(m_canvas->rect());
 
-    if (m_canvas)
-        painter.drawPixmap(0, 0, *m_canvas);
-    if (m_overlay)
-        painter.drawPixmap(0, 0, *m_overlay);
+    // only the damaged rects, mapped to whole pixels of the pixmaps so that no partially
+    // sampled pixel is left at the edges with a fractional scale
+    for (const QRect &rect : event->region()) {
+        QRect area{
+            QRectF{QPointF{rect.topLeft()} * m_scale, QSizeF{rect.size()} * m_scale}
+                .toAlignedRect()};
+
+        if (m_canvas)
+            painter.drawPixmap(area, *m_canvas, area);
+        if (m_overlay)
+            painter.drawPixmap(area, *m_overlay, area);
+    }
 }
 
 // just a small overload
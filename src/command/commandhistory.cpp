@@ -20,6 +20,9 @@
 
 #include <QDebug>
 
+#include "../context/applicationcontext.hpp"
+#include "../context/spatialcontext.hpp"
+
 CommandHistory::CommandHistory(ApplicationContext *context) : m_context{context} {
     m_undoStack = std::make_unique<std::deque<std::shared_ptr<Command>>>();
     m_redoStack = std::make_unique<std::deque<std::shared_ptr<Command>>>();
@@ -42,6 +45,7 @@ void CommandHistory::undo() {
         m_redoStack->pop_back();
 
     m_undoStack->pop_front();
+    m_context->spatialContext().scheduleCompaction();
 }
 
 void CommandHistory::redo() {
@@ -56,6 +60,7 @@ void CommandHistory::redo() {
         m_undoStack->pop_back();
 
     m_redoStack->pop_front();
+    m_context->spatialContext().scheduleCompaction();
 }
 
 void CommandHistory::insert(std::shared_ptr<Command> command) {
@@ -68,6 +73,8 @@ void CommandHistory::insert(std::shared_ptr<Command> command) {
     m_undoStack->push_front(command);
     if (m_undoStack->size() == maxCommands)
         m_undoStack->pop_back();
+
+    m_context->spatialContext().scheduleCompaction();
 }
 
 void CommandHistory::clear() {
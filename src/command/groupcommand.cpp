@@ -26,30 +26,34 @@
 #include "../context/selectioncontext.hpp"
 #include "../context/spatialcontext.hpp"
 #include "../data-structures/cachegrid.hpp"
-#include "../data-structures/quadtree.hpp"
+#include "../data-structures/orderedlist.hpp"
+#include "../data-structures/spatialindex.hpp"
 #include "../item/group.hpp"
 
 GroupCommand::GroupCommand(QVector<std::shared_ptr<Item>> items) : ItemCommand{items} {
     m_group = std::make_shared<GroupItem>();
 
     // sort according to z order
-    ApplicationContext::instance()->spatialContext().quadtree().reorder(m_items);
+    ApplicationContext::instance()->spatialContext().spatialIndex().reorder(m_items);
 }
 
 GroupCommand::~GroupCommand() {
 }
 
 void GroupCommand::execute(ApplicationContext *context) {
-    auto &quadtree{context->spatialContext().quadtree()};
+    auto &spatialIndex{context->spatialContext().spatialIndex()};
     auto &selectedItems{context->selectionContext().selectedItems()};
 
+    m_group->group(m_items);
+
+    // the group takes the place of its topmost item in the stacking order
+    spatialIndex.insertItem(m_group, false);
+    spatialIndex.orderedList().insertBlock({m_group}, m_items.empty() ? nullptr : m_items.back());
+
     for (const auto item : m_items) {
-        quadtree.deleteItem(item, false);
+        spatialIndex.deleteItem(item);
     }
 
-    m_group->group(m_items);
-    quadtree.insertItem(m_group);
-
     selectedItems.clear();
     selectedItems.insert(m_group);
 
@@ -57,16 +61,18 @@ void GroupCommand::execute(ApplicationContext *context) {
 }
 
 void GroupCommand::undo(ApplicationContext *context) {
-    auto &quadtree{context->spatialContext().quadtree()};
+    auto &spatialIndex{context->spatialContext().spatialIndex()};
     auto &selectedItems{context->selectionContext().selectedItems()};
 
-    quadtree.deleteItem(m_group);
     selectedItems.clear();
 
     for (const auto item : m_items) {
         selectedItems.insert(item);
-        quadtree.insertItem(item, false);
+        spatialIndex.insertItem(item, false);
     }
 
+    spatialIndex.orderedList().insertBlock(m_items, m_group);
+    spatialIndex.deleteItem(m_group);
+
     context->spatialContext().cacheGrid().markDirty(m_group->boundingBox().toRect());
 }
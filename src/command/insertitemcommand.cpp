@@ -23,7 +23,7 @@
 #include "../context/selectioncontext.hpp"
 #include "../context/spatialcontext.hpp"
 #include "../data-structures/cachegrid.hpp"
-#include "../data-structures/quadtree.hpp"
+#include "../data-structures/spatialindex.hpp"
 
 InsertItemCommand::InsertItemCommand(QVector<std::shared_ptr<Item>> items) : ItemCommand{items} {
 }
@@ -33,19 +33,19 @@ InsertItemCommand::~InsertItemCommand() {
 
 void InsertItemCommand::execute(ApplicationContext *context) {
     auto &transformer{context->spatialContext().coordinateTransformer()};
-    auto &quadtree{context->spatialContext().quadtree()};
+    auto &spatialIndex{context->spatialContext().spatialIndex()};
     auto &cacheGrid{context->spatialContext().cacheGrid()};
 
     for (auto &item : m_items) {
         QRect dirtyRegion{transformer.worldToGrid(item->boundingBox()).toRect()};
-        quadtree.insertItem(item);
+        spatialIndex.insertItem(item);
         cacheGrid.markDirty(dirtyRegion);
     }
 }
 
 void InsertItemCommand::undo(ApplicationContext *context) {
     auto &transformer{context->spatialContext().coordinateTransformer()};
-    auto &quadtree{context->spatialContext().quadtree()};
+    auto &spatialIndex{context->spatialContext().spatialIndex()};
     auto &cacheGrid{context->spatialContext().cacheGrid()};
     auto &selectedItems{context->selectionContext().selectedItems()};
 
@@ -53,7 +53,7 @@ void InsertItemCommand::undo(ApplicationContext *context) {
         QRect dirtyRegion{transformer.worldToGrid(item->boundingBox()).toRect()};
 
         selectedItems.erase(item);
-        quadtree.deleteItem(item);
+        spatialIndex.deleteItem(item);
         cacheGrid.markDirty(dirtyRegion);
     }
 }
@@ -23,7 +23,7 @@
 #include "../context/coordinatetransformer.hpp"
 #include "../context/spatialcontext.hpp"
 #include "../data-structures/cachegrid.hpp"
-#include "../data-structures/quadtree.hpp"
+#include "../data-structures/spatialindex.hpp"
 #include "../item/item.hpp"
 
 MoveItemCommand::MoveItemCommand(QVector<std::shared_ptr<Item>> items, QPointF delta)
@@ -33,7 +33,7 @@ MoveItemCommand::MoveItemCommand(QVector<std::shared_ptr<Item>> items, QPointF d
 
 void MoveItemCommand::execute(ApplicationContext *context) {
     auto &transformer{context->spatialContext().coordinateTransformer()};
-    auto &quadtree{context->spatialContext().quadtree()};
+    auto &spatialIndex{context->spatialContext().spatialIndex()};
     auto &cacheGrid{context->spatialContext().cacheGrid()};
 
     for (auto &item : m_items) {
@@ -41,13 +41,14 @@ void MoveItemCommand::execute(ApplicationContext *context) {
 
         cacheGrid.markDirty(transformer.worldToGrid(item->boundingBox()).toRect());
         item->translate(m_delta);
+        spatialIndex.updateItem(item);
         cacheGrid.markDirty(transformer.worldToGrid(item->boundingBox()).toRect());
     }
 }
 
 void MoveItemCommand::undo(ApplicationContext *context) {
     auto &transformer{context->spatialContext().coordinateTransformer()};
-    auto &quadtree{context->spatialContext().quadtree()};
+    auto &spatialIndex{context->spatialContext().spatialIndex()};
     auto &cacheGrid{context->spatialContext().cacheGrid()};
 
     for (auto &item : m_items) {
@@ -55,6 +56,7 @@ void MoveItemCommand::undo(ApplicationContext *context) {
 
         cacheGrid.markDirty(transformer.worldToGrid(item->boundingBox()).toRect());
         item->translate(-m_delta);
+        spatialIndex.updateItem(item);
         cacheGrid.markDirty(transformer.worldToGrid(item->boundingBox()).toRect());
     }
 }
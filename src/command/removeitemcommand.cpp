@@ -24,7 +24,7 @@
 #include "../context/selectioncontext.hpp"
 #include "../context/spatialcontext.hpp"
 #include "../data-structures/cachegrid.hpp"
-#include "../data-structures/quadtree.hpp"
+#include "../data-structures/spatialindex.hpp"
 #include "../item/item.hpp"
 
 RemoveItemCommand::RemoveItemCommand(QVector<std::shared_ptr<Item>> items) : ItemCommand{items} {
@@ -35,7 +35,7 @@ RemoveItemCommand::~RemoveItemCommand() {
 
 void RemoveItemCommand::execute(ApplicationContext *context) {
     auto &transformer{context->spatialContext().coordinateTransformer()};
-    auto &quadtree{context->spatialContext().quadtree()};
+    auto &spatialIndex{context->spatialContext().spatialIndex()};
     auto &cacheGrid{context->spatialContext().cacheGrid()};
     auto &selectedItems{context->selectionContext().selectedItems()};
 
@@ -43,20 +43,20 @@ void RemoveItemCommand::execute(ApplicationContext *context) {
         QRect dirtyRegion{transformer.worldToGrid(item->boundingBox()).toRect()};
 
         selectedItems.erase(item);
-        quadtree.deleteItem(item, false);
+        spatialIndex.deleteItem(item, false);
         cacheGrid.markDirty(dirtyRegion);
     }
 }
 
 void RemoveItemCommand::undo(ApplicationContext *context) {
     auto &transformer{context->spatialContext().coordinateTransformer()};
-    auto &quadtree{context->spatialContext().quadtree()};
+    auto &spatialIndex{context->spatialContext().spatialIndex()};
     auto &cacheGrid{context->spatialContext().cacheGrid()};
 
     for (auto &item : m_items) {
         QRect dirtyRegion{transformer.worldToGrid(item->boundingBox()).toRect()};
 
-        quadtree.insertItem(item, false);
+        spatialIndex.insertItem(item, false);
         cacheGrid.markDirty(dirtyRegion);
     }
 }
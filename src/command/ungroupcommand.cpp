@@ -23,7 +23,8 @@
 #include "../context/selectioncontext.hpp"
 #include "../context/spatialcontext.hpp"
 #include "../data-structures/cachegrid.hpp"
-#include "../data-structures/quadtree.hpp"
+#include "../data-structures/orderedlist.hpp"
+#include "../data-structures/spatialindex.hpp"
 #include "../item/group.hpp"
 #include <memory>
 
@@ -39,7 +40,7 @@ UngroupCommand::~UngroupCommand() {
 }
 
 void UngroupCommand::execute(ApplicationContext *context) {
-    auto &quadtree{context->spatialContext().quadtree()};
+    auto &spatialIndex{context->spatialContext().spatialIndex()};
     auto &selectedItems{context->selectionContext().selectedItems()};
 
     selectedItems.clear();
@@ -48,35 +49,39 @@ void UngroupCommand::execute(ApplicationContext *context) {
 
     QRectF dirtyRegion{};
     for (const auto group : m_groups) {
-        quadtree.deleteItem(group);
-
         dirtyRegion |= group->boundingBox();
 
+        // the items of the group go where the group was in the stacking order
         auto subItems{group->unGroup()};
         for (const auto subItem : subItems) {
-            quadtree.insertItem(subItem, false);
+            spatialIndex.insertItem(subItem, false);
             selectedItems.insert(subItem);
         }
+
+        spatialIndex.orderedList().insertBlock(subItems, group);
+        spatialIndex.deleteItem(group);
     }
 
     context->spatialContext().cacheGrid().markDirty(dirtyRegion.toRect());
 }
 
 void UngroupCommand::undo(ApplicationContext *context) {
-    auto &quadtree{context->spatialContext().quadtree()};
+    auto &spatialIndex{context->spatialContext().spatialIndex()};
     auto &selectedItems{context->selectionContext().selectedItems()};
 
     selectedItems.clear();
 
     QRectF dirtyRegion{};
     for (const auto group : m_groups) {
-        quadtree.insertItem(group);
         selectedItems.insert(group);
         dirtyRegion |= group->boundingBox();
 
         auto subItems{group->unGroup()};
+        spatialIndex.insertItem(group, false);
+        spatialIndex.orderedList().insertBlock({group}, subItems.empty() ? nullptr : subItems.back());
+
         for (const auto subItem : subItems) {
-            quadtree.deleteItem(subItem, false);
+            spatialIndex.deleteItem(subItem);
         }
     }
 
@@ -24,6 +24,7 @@
 #include "../context/coordinatetransformer.hpp"
 #include "../context/spatialcontext.hpp"
 #include "../data-structures/cachegrid.hpp"
+#include "../data-structures/spatialindex.hpp"
 #include "../item/item.hpp"
 #include "../properties/property.hpp"
 
@@ -35,12 +36,17 @@ UpdatePropertyCommand::UpdatePropertyCommand(QVector<std::shared_ptr<Item>> item
 
 void UpdatePropertyCommand::execute(ApplicationContext *context) {
     Property::Type type{m_newProperty.type()};
+    auto &spatialIndex{context->spatialContext().spatialIndex()};
 
     QRectF dirtyRegion{};
     for (auto &item : m_items) {
         try {
             m_properties[item] = item->property(type);
+            dirtyRegion |= item->boundingBox();
+
+            // some properties, like the stroke width, change the bounding box
             item->setProperty(type, m_newProperty);
+            spatialIndex.updateItem(item);
             dirtyRegion |= item->boundingBox();
         } catch (const std::logic_error &e) {
             // Ignore if not found
@@ -54,11 +60,15 @@ void UpdatePropertyCommand::execute(ApplicationContext *context) {
 
 void UpdatePropertyCommand::undo(ApplicationContext *context) {
     Property::Type type{m_newProperty.type()};
+    auto &spatialIndex{context->spatialContext().spatialIndex()};
 
     QRectF dirtyRegion{};
     for (auto &item : m_items) {
         try {
+            dirtyRegion |= item->boundingBox();
+
             item->setProperty(type, m_properties[item]);
+            spatialIndex.updateItem(item);
             dirtyRegion |= item->boundingBox();
         } catch (const std::logic_error &e) {
             // Ignore if not found
@@ -34,6 +34,9 @@ inline constexpr int eraserBorderWidth{2};
 inline constexpr QColor selectionBorderColor{67, 135, 244, 255};
 inline constexpr QColor selectionBackgroundColor{67, 135, 244, 50};
 
+inline constexpr QColor debugOverlayColor{0, 255, 0};
+inline constexpr QColor debugOverlayBackgroundColor{0, 0, 0, 180};
+
 inline constexpr unsigned int erasedItemColor{0x6E6E6E96};
 
 inline constexpr QColor lightBackgroundColor{248, 249, 250};
@@ -55,6 +58,29 @@ inline constexpr std::array<QChar, 38> wordSeparators{
     ';',  '<',  '=',  '>',  '?',  '@', '[',  '\\', ']', '^', '_', '`', '{', '|', '}', '~'};
 
 inline constexpr int doubleClickInterval{300};  // milliseconds
+inline constexpr qreal hitTestTolerance{2};      // in pixels, around the cursor
+
+// the long standing quadtree defaults, to be changed only on real drawy_bench numbers for
+// every board (--capacity and --min-node-size run the comparison)
+inline constexpr int quadTreeCapacity{100};              // items per node before it may split
+inline constexpr qreal quadTreeTileSize{4096};           // in world units
+inline constexpr int quadTreeTileLevels{3};              // tile sizes for larger and larger items
+inline constexpr int quadTreeLevelFactor{8};             // tile size ratio between two levels
+inline constexpr qreal minQuadTreeNodeSize{1};           // in world units
+inline constexpr int spatialIndexCompactionDelay{5000};  // milliseconds of inactivity
+inline constexpr int rTreeNodeCapacity{16};              // entries per node
+inline constexpr qreal gridIndexCellSize{512};           // in world units
+inline constexpr int gridIndexMaxCells{64};              // larger items are kept on their own
+
+inline constexpr qsizetype cacheGridBudget{256};  // in MiB, the most rendered cells may take
+inline constexpr int cacheGridStandInLevels{2};   // zoom levels searched for stand-in cells
+inline constexpr int cacheGridEmptyCells{4096};    // cells kept without an image, which cost little
+inline constexpr int zoomRefinementDelay{150};    // milliseconds after the last zoom step
+inline constexpr int frameRenderBudget{8};        // milliseconds of cell rendering per frame
+inline constexpr int prefetchLookahead{250};      // milliseconds of panning rendered ahead
+inline constexpr int panSmoothingWindow{100};     // milliseconds between frames still averaged
+
+inline constexpr qint64 zIndexGap{qint64{1} << 32};  // spacing between appended z-indices
 
 inline constexpr qreal tabStopDistance{4};
 
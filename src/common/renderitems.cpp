@@ -18,8 +18,20 @@
 
 #include "renderitems.hpp"
 
+#include <QFontMetrics>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QImage>
+#include <QPainter>
 #include <QPointF>
 #include <QRectF>
+#include <QRegion>
+#include <QSet>
+#include <QStringList>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentMap>
+#include <algorithm>
+#include <iterator>
 #include <memory>
 
 #include "../canvas/canvas.hpp"
@@ -29,58 +41,348 @@
 #include "../context/selectioncontext.hpp"
 #include "../context/spatialcontext.hpp"
 #include "../data-structures/cachegrid.hpp"
-#include "../data-structures/quadtree.hpp"
+#include "../data-structures/spatialindex.hpp"
 #include "../item/item.hpp"
 #include "constants.hpp"
 
+// the layout of the spatial index and what the queries since the last frame cost
+static void renderDebugOverlay(ApplicationContext *context) {
+    SpatialIndex &spatialIndex{context->spatialContext().spatialIndex()};
+    QPainter &canvasPainter{context->renderingContext().canvasPainter()};
+    qreal zoomFactor{context->renderingContext().zoomFactor()};
+
+    canvasPainter.save();
+    canvasPainter.scale(zoomFactor, zoomFactor);
+    spatialIndex.draw(canvasPainter, context->spatialContext().offsetPos());
+    canvasPainter.restore();
+
+    SpatialIndex::Stats stats{spatialIndex.stats()};
+    SpatialIndex::QueryCost cost{spatialIndex.queryCost()};
+    spatialIndex.resetQueryCost();
+
+    QStringList occupancy{};
+    for (qsizetype bucket{0}; bucket < stats.occupancy.size(); bucket++) {
+        if (stats.occupancy[bucket] == 0) {
+            continue;
+        }
+
+        qsizetype low{bucket == 0 ? 0 : qsizetype{1} << (bucket - 1)};
+        qsizetype high{bucket == 0 ? 0 : (qsizetype{1} << bucket) - 1};
+        QString items{low == high ? QString::number(low) : QString{"%1-%2"}.arg(low).arg(high)};
+        occupancy.push_back(QString{"%1: %2"}.arg(items).arg(stats.occupancy[bucket]));
+    }
+
+    qreal queries{static_cast<qreal>(std::max<qint64>(cost.queries, 1))};
+    QStringList lines{
+        QString{"%1, %2 items"}.arg(spatialIndex.name()).arg(stats.items),
+        QString{"nodes: %1, leaves: %2"}.arg(stats.nodes).arg(stats.leaves),
+        QString{"depth: max %1, mean %2"}.arg(stats.maxDepth).arg(stats.meanDepth, 0, 'f', 2),
+        QString{"duplication: %1"}.arg(stats.duplication(), 0, 'f', 2),
+        QString{"items per leaf: %1"}.arg(occupancy.join(", ")),
+        QString{"queries: %1"}.arg(cost.queries),
+        QString{"per query: %1 nodes, %2 boxes, %3 items tested"}
+            .arg(cost.nodesVisited / queries, 0, 'f', 1)
+            .arg(cost.candidatesTested / queries, 0, 'f', 1)
+            .arg(cost.itemsTested / queries, 0, 'f', 1)};
+
+    QFontMetrics metrics{canvasPainter.fontMetrics()};
+    int width{0};
+    for (const QString &line : lines) {
+        width = std::max(width, metrics.horizontalAdvance(line));
+    }
+
+    constexpr int padding{8};
+    int lineCount{static_cast<int>(lines.size())};
+    QRect panel{0, 0, width + 2 * padding, metrics.height() * lineCount + 2 * padding};
+
+    canvasPainter.save();
+    canvasPainter.fillRect(panel, Common::debugOverlayBackgroundColor);
+    canvasPainter.setPen(Common::debugOverlayColor);
+    for (int line{0}; line < lineCount; line++) {
+        canvasPainter.drawText(
+            padding, padding + metrics.ascent() + metrics.height() * line, lines[line]);
+    }
+    canvasPainter.restore();
+}
+
+namespace {
+struct CellJob {
+    std::shared_ptr<CacheCell> cell;
+    QVector<std::shared_ptr<Item>> items;
+    QPointF topLeftPoint;
+    QImage image;
+    QRegion region;  // what to draw again, empty for the whole cell
+};
+}  // namespace
+
+// runs on a worker thread, so it must not touch anything but the job
+static void renderCell(CellJob &job, qreal levelScale) {
+    if (job.region.isEmpty()) {
+        job.image.fill(Qt::transparent);
+    }
+
+    // only open while the cell is being rendered
+    QPainter painter{&job.image};
+    if (!job.region.isEmpty()) {
+        // the rest of the image is still up to date
+        painter.setClipRegion(job.region);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.fillRect(job.region.boundingRect(), Qt::transparent);
+        painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    }
+
+    painter.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform);
+    painter.scale(levelScale, levelScale);
+
+    for (const auto &item : job.items) {
+        item->draw(painter, job.topLeftPoint);
+    }
+}
+
+// renders the cells and swaps their new images in
+static void renderCells(ApplicationContext *context,
+                        const QVector<std::shared_ptr<CacheCell>> &cells,
+                        qreal levelScale) {
+    CacheGrid &cacheGrid{context->spatialContext().cacheGrid()};
+    SpatialIndex &spatialIndex{context->spatialContext().spatialIndex()};
+
+    // the same items the cells are drawn with, everything whose box reaches into the rect
+    auto hasItems = [&](const QRectF &worldRect) {
+        bool found{false};
+        spatialIndex.visitItems(
+            worldRect,
+            [](const auto &, const auto &) { return true; },
+            [&](const auto &) {
+                found = true;
+                return false;
+            });
+        return found;
+    };
+
+    // the spatial index isn't thread safe, so the items of each cell are collected here and
+    // only the drawing is spread across the thread pool
+    QVector<CellJob> jobs{};
+    QRect cellRect{QPoint{0, 0}, CacheCell::cellSize()};
+    for (auto cell : cells) {
+        // a small edit only redraws the items around it, unless the cell has no image to keep
+        QRegion region{cell->image().isNull() ? QRegion{} : cell->dirtyRegion()};
+        if (region == QRegion{cellRect}) {
+            region = QRegion{};
+        }
+
+        QRect dirtyRect{region.isEmpty() ? cellRect : region.boundingRect()};
+        QRectF worldRect{cell->worldRect().topLeft() + dirtyRect.topLeft().toPointF() / levelScale,
+                         dirtyRect.size().toSizeF() / levelScale};
+
+        QVector<std::shared_ptr<Item>> items{
+            spatialIndex.queryItems(worldRect, [](const auto &, const auto &) { return true; })};
+
+        // most of the canvas is empty, those cells don't need an image at all, and an edit
+        // may just have taken the last item out of a cell which is only partly redrawn
+        if (items.empty() && (region.isEmpty() || !hasItems(cell->worldRect()))) {
+            cacheGrid.releaseImage(*cell);
+            cell->setDirty(false);
+            continue;
+        }
+
+        jobs.push_back({cell,
+                        std::move(items),
+                        cell->worldRect().topLeft(),
+                        cacheGrid.acquireImage(*cell),
+                        std::move(region)});
+    }
+
+    // items are only read while drawing and nothing modifies them until this returns
+    auto renderJob = [levelScale](CellJob &job) { renderCell(job, levelScale); };
+    if (jobs.size() == 1) {
+        renderJob(jobs.front());
+    } else if (!jobs.empty()) {
+        QtConcurrent::blockingMap(jobs, renderJob);
+    }
+
+    for (CellJob &job : jobs) {
+        cacheGrid.storeImage(*job.cell, std::move(job.image));
+        job.cell->setDirty(false);
+    }
+}
+
 // TODO: Refactor this
 void Common::renderCanvas(ApplicationContext *context) {
     CoordinateTransformer &transformer{context->spatialContext().coordinateTransformer()};
     Canvas &canvas{context->renderingContext().canvas()};
     QPointF offsetPos{context->spatialContext().offsetPos()};
 
-    canvas.canvas()->fill(canvas.bg());
+    QPainter &canvasPainter{context->renderingContext().canvasPainter()};
+    CacheGrid &cacheGrid{context->spatialContext().cacheGrid()};
+    qreal zoomFactor{context->renderingContext().zoomFactor()};
+
+    // cells are rendered at the level at or above the zoom and scaled down while compositing
+    int level{CacheGrid::levelFor(zoomFactor)};
+    qreal levelScale{CacheGrid::levelScale(level)};
 
-    QPointF gridOffset{transformer.worldToGrid(offsetPos)};
-    QRectF gridViewport(gridOffset, transformer.viewToGrid(canvas.dimensions()));
+    QRectF worldViewport{offsetPos, transformer.viewToWorld(canvas.dimensions().toSizeF())};
+    QRectF levelViewport{worldViewport.topLeft() * levelScale, worldViewport.size() * levelScale};
 
     QVector<std::shared_ptr<CacheCell>> visibleCells{
-        context->spatialContext().cacheGrid().queryCells(transformer.round(gridViewport))};
-
-    QPainter &canvasPainter{context->renderingContext().canvasPainter()};
+        cacheGrid.queryCells(level, transformer.round(levelViewport))};
 
+    // while zooming, cells which other levels can stand in for are left for later
+    bool zooming{context->renderingContext().zooming()};
+    QVector<std::shared_ptr<CacheCell>> dirtyCells{};
+    QVector<std::shared_ptr<CacheCell>> skippedCells{};
     for (auto cell : visibleCells) {
-        // canvasPainter.save();
-        // QPen pen; pen.setColor(Qt::white); canvasPainter.setPen(pen);
-        // canvasPainter.drawRect(transformer.gridToView(cell->rect()));
-        // canvasPainter.restore();
+        if (!cell->dirty()) {
+            continue;
+        }
 
-        if (cell->dirty()) {
-            cell->image().fill(Qt::transparent);
-            cell->setDirty(false);
+        if (zooming && !cacheGrid.standInCells(*cell).empty()) {
+            skippedCells.push_back(cell);
+        } else {
+            dirtyCells.push_back(cell);
+        }
+    }
 
-            QVector<std::shared_ptr<Item>> intersectingItems{
-                context->spatialContext().quadtree().queryItems(
-                    transformer.gridToWorld(cell->rect()),
-                    [](auto a, auto b) { return true; })};
+    // the middle of the viewport first, it is where the user is looking
+    QPointF center{levelViewport.center()};
+    auto distance = [&](const std::shared_ptr<CacheCell> &cell) {
+        QPointF delta{cell->rect().toRectF().center() - center};
+        return QPointF::dotProduct(delta, delta);
+    };
+    std::ranges::sort(dirtyCells, {}, distance);
 
-            if (intersectingItems.empty())
-                continue;
+    // one batch keeps every thread busy, cells are rendered until the frame budget is spent
+    QElapsedTimer elapsed{};
+    elapsed.start();
+    qsizetype batchSize{std::max(QThreadPool::globalInstance()->maxThreadCount(), 1)};
+    auto renderInBatches = [&](const QVector<std::shared_ptr<CacheCell>> &cells, bool force) {
+        qsizetype next{0};
+        while (next < cells.size() &&
+               ((force && next == 0) ||
+                !elapsed.hasExpired(context->renderingContext().frameBudget()))) {
+            renderCells(context, cells.mid(next, batchSize), levelScale);
+            next += batchSize;
+        }
+        return std::min(next, cells.size());
+    };
 
-            qreal zoomFactor{context->renderingContext().zoomFactor()};
+    // at least one batch is rendered to make progress, the rest is finished over the next frames
+    qsizetype rendered{renderInBatches(dirtyCells, true)};
+    skippedCells.append(dirtyCells.mid(rendered));
+    if (rendered < dirtyCells.size()) {
+        context->renderingContext().markForRender();
+    }
 
-            QPointF topLeftPoint{transformer.gridToWorld(cell->rect().topLeft().toPointF())};
+    // the cells the view is being panned towards are rendered ahead with the time left, and
+    // kept in the cache until the next frame decides again
+    QVector<std::shared_ptr<CacheCell>> aheadCells{};
+    QPointF panVelocity{context->renderingContext().panVelocity()};
+    if (skippedCells.empty() && !panVelocity.isNull()) {
+        QPointF shift{panVelocity * levelScale * Common::prefetchLookahead / 1000.0};
+        QRectF aheadViewport{levelViewport.translated(shift)};
 
-            cell->painter().resetTransform();
-            cell->painter().scale(zoomFactor, zoomFactor);
+        QSet<const CacheCell *> visible{};
+        for (const auto &cell : visibleCells) {
+            visible.insert(cell.get());
+        }
 
-            for (auto intersectingItem : intersectingItems) {
-                intersectingItem->draw(cell->painter(), topLeftPoint);
+        for (auto cell : cacheGrid.queryCells(level, transformer.round(aheadViewport))) {
+            if (!visible.contains(cell.get())) {
+                aheadCells.push_back(cell);
             }
         }
+    }
+    cacheGrid.protectCells(aheadCells);
+
+    QVector<std::shared_ptr<CacheCell>> dirtyAheadCells{};
+    std::ranges::copy_if(aheadCells, std::back_inserter(dirtyAheadCells), &CacheCell::dirty);
+    std::ranges::sort(dirtyAheadCells, {}, distance);
+    renderInBatches(dirtyAheadCells, false);
 
-        canvasPainter.drawPixmap(transformer.round(transformer.gridToView(cell->rect())),
-                                 cell->image());
+    QHash<const CacheCell *, QVector<std::shared_ptr<CacheCell>>> standIns{};
+    for (auto cell : skippedCells) {
+        standIns.insert(cell.get(), cacheGrid.standInCells(*cell));
+    }
+
+    auto viewRect = [&](const CacheCell &cell) {
+        return transformer.round(transformer.worldToView(cell.worldRect()));
+    };
+    auto drawCell = [&](const CacheCell &cell) {
+        if (!cell.image().isNull()) {
+            canvasPainter.drawImage(viewRect(cell), cell.image());
+        }
+    };
+
+    // when the view moved by whole pixels since the last frame, the canvas is scrolled and
+    // only what it uncovers and what changed is composed again
+    RenderingContext::Composition &composition{context->renderingContext().composition()};
+    bool debugOverlay{context->renderingContext().debugOverlay()};
+    QRect canvasRect{QPoint{0, 0}, canvas.dimensions()};
+    QPointF gridOffset{offsetPos * zoomFactor};
+    QPointF shift{composition.gridOffset - gridOffset};
+    QPoint pixelShift{transformer.round(shift)};
+
+    constexpr qreal tolerance{1e-6};
+    bool scrollable{composition.valid && !debugOverlay &&
+                    composition.zoomFactor == zoomFactor &&
+                    composition.size == canvas.dimensions() &&
+                    composition.background == canvas.bg() &&
+                    (shift - pixelShift.toPointF()).manhattanLength() < tolerance};
+
+    QRegion damage{canvasRect};
+    if (scrollable) {
+        damage = QRegion{};
+        if (!pixelShift.isNull()) {
+            damage += context->renderingContext().scrollCanvas(pixelShift, canvasRect);
+        }
+
+        damage += composition.decorations.translated(pixelShift);
+        for (const auto &cell : dirtyCells.first(rendered)) {
+            damage += viewRect(*cell);
+        }
+        for (const auto &cell : skippedCells) {
+            damage += viewRect(*cell);
+        }
+    }
+
+    canvasPainter.save();
+    canvasPainter.setClipRegion(damage);
+    canvasPainter.setCompositionMode(QPainter::CompositionMode_Source);
+    canvasPainter.fillRect(damage.boundingRect(), canvas.bg());
+    canvasPainter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+
+    for (auto cell : visibleCells) {
+        // canvasPainter.save();
+        // QPen pen; pen.setColor(Qt::white); canvasPainter.setPen(pen);
+        // canvasPainter.drawRect(viewRect(*cell));
+        // canvasPainter.restore();
+
+        if (!damage.intersects(viewRect(*cell))) {
+            continue;
+        }
+
+        // a skipped cell shows what other levels have of it, or else its outdated image
+        if (standIns.value(cell.get()).empty()) {
+            drawCell(*cell);
+            continue;
+        }
+
+        canvasPainter.save();
+        canvasPainter.setClipRect(viewRect(*cell), Qt::IntersectClip);
+        for (const auto &standIn : standIns[cell.get()]) {
+            drawCell(*standIn);
+        }
+        canvasPainter.restore();
+    }
+    canvasPainter.restore();
+
+    // the widget repaints what was drawn over, on top of what its producers marked
+    context->renderingContext().markForUpdate(damage);
+
+    // the overlay covers the whole canvas, so the next frame can't start from this one
+    composition = {!debugOverlay, zoomFactor, gridOffset, canvas.dimensions(), canvas.bg(), {}};
+
+    if (debugOverlay) {
+        renderDebugOverlay(context);
     }
 
     QRectF selectionBox{};
@@ -105,4 +407,9 @@ void Common::renderCanvas(ApplicationContext *context) {
     canvasPainter.setPen(pen);
     canvasPainter.drawRect(selectionBox);
     canvasPainter.restore();
+
+    int margin{pen.width() + 1};
+    composition.decorations =
+        selectionBox.toAlignedRect().adjusted(-margin, -margin, margin, margin);
+    context->renderingContext().markForUpdate(composition.decorations);
 }
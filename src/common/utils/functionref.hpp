@@ -0,0 +1,55 @@
+/*
+ * Drawy - A simple brainstorming tool with an infinite canvas
+ * Copyright (C) 2025 - Prayag Jain <prayagjain2@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace Common::Utils {
+template <typename Signature>
+class FunctionRef;
+
+// A non-owning reference to a callable, like std::function but without any allocation.
+// It must not outlive the callable it was made from, which makes it meant for
+// parameters only.
+template <typename Result, typename... Args>
+class FunctionRef<Result(Args...)> {
+public:
+    template <typename Callable>
+        requires(!std::is_same_v<std::remove_cvref_t<Callable>, FunctionRef> &&
+                 std::is_invocable_r_v<Result, Callable &, Args...>)
+    FunctionRef(Callable &&callable)
+        : m_callable{const_cast<void *>(static_cast<const void *>(std::addressof(callable)))},
+          m_invoke{[](void *callable, Args... args) -> Result {
+              return std::invoke(*static_cast<std::remove_reference_t<Callable> *>(callable),
+                                 std::forward<Args>(args)...);
+          }} {
+    }
+
+    Result operator()(Args... args) const {
+        return m_invoke(m_callable, std::forward<Args>(args)...);
+    }
+
+private:
+    void *m_callable{};
+    Result (*m_invoke)(void *, Args...){};
+};
+};  // namespace Common::Utils
@@ -21,8 +21,10 @@
 #include <QScreen>
 
 #include "../canvas/canvas.hpp"
+#include "../common/constants.hpp"
 #include "../common/renderitems.hpp"
 #include "../data-structures/cachegrid.hpp"
+#include "../data-structures/spatialindex.hpp"
 #include "applicationcontext.hpp"
 #include "spatialcontext.hpp"
 
@@ -47,26 +49,58 @@ void RenderingContext::setRenderingContext() {
     QObject::connect(m_canvas, &Canvas::resizeEnd, this, &RenderingContext::beginPainters);
     QObject::connect(m_canvas, &Canvas::resizeEventCalled, this, &RenderingContext::canvasResized);
 
+    // anything which is not a positive number is ignored
+    bool ok{false};
+    int frameBudget{qEnvironmentVariable("DRAWY_FRAME_BUDGET_MS").toInt(&ok)};
+    m_frameBudget = ok && frameBudget > 0 ? frameBudget : Common::frameRenderBudget;
+
+    // cells missing at the new zoom level are rendered once the zooming stops
+    m_zoomTimer.setSingleShot(true);
+    m_zoomTimer.setInterval(Common::zoomRefinementDelay);
+    QObject::connect(&m_zoomTimer, &QTimer::timeout, this, [&]() { markForRender(); });
+
+    // frames are only drawn when something was marked, see scheduleFrame
+    m_frameTimer.setSingleShot(true);
+    m_frameTimer.setTimerType(Qt::PreciseTimer);
     QObject::connect(&m_frameTimer, &QTimer::timeout, m_canvas, [&]() {
+        m_lastFrame.start();
+        m_inFrame = true;
+
         if (m_needsReRender) {
-            Common::renderCanvas(m_applicationContext);
+            // cleared first, a frame which runs out of time asks for another one
             m_needsReRender = false;
+            updatePanVelocity();
+            Common::renderCanvas(m_applicationContext);
         }
 
         if (m_needsUpdate) {
-            if (m_updateRegion.width() == 0 || m_updateRegion.height() == 0) {
-                m_canvas->update();
-            } else {
-                m_canvas->update(m_updateRegion);
+            m_canvas->update();
+        } else if (!m_updateRegion.isEmpty()) {
+            // the region is in canvas pixels, the widget counts device independent ones
+            qreal scale{m_canvas->scale()};
+            QRegion widgetRegion{};
+            for (const QRect &rect : m_updateRegion) {
+                widgetRegion +=
+                    QRectF{QPointF{rect.topLeft()} / scale, QSizeF{rect.size()} / scale}
+                        .toAlignedRect();
             }
+            m_canvas->update(widgetRegion);
+        }
+
+        m_updateRegion = QRegion{};
+        m_needsUpdate = false;
+        m_inFrame = false;
 
-            m_updateRegion.setWidth(0);
-            m_updateRegion.setHeight(0);
-            m_needsUpdate = false;
+        // a render which ran out of time asked for another frame
+        if (m_needsReRender) {
+            scheduleFrame();
         }
     });
 
-    m_frameTimer.start(1000 / fps());
+    // anything marked before the canvas existed
+    if (m_needsReRender || m_needsUpdate || !m_updateRegion.isEmpty()) {
+        scheduleFrame();
+    }
 }
 
 Canvas &RenderingContext::canvas() const {
@@ -81,6 +115,23 @@ QPainter &RenderingContext::overlayPainter() const {
     return *m_overlayPainter;
 }
 
+RenderingContext::Composition &RenderingContext::composition() {
+    return m_composition;
+}
+
+QRegion RenderingContext::scrollCanvas(const QPoint &delta, const QRect &rect) {
+    // a pixmap can't be scrolled while it is being painted on
+    QPainter::RenderHints renderHints{m_canvasPainter->renderHints()};
+    m_canvasPainter->end();
+
+    QRegion exposed{};
+    m_canvas->canvas()->scroll(delta.x(), delta.y(), rect, &exposed);
+
+    m_canvasPainter->begin(m_canvas->canvas());
+    m_canvasPainter->setRenderHints(renderHints);
+    return exposed;
+}
+
 // PRIVATE SLOTS
 void RenderingContext::endPainters() {
     if (m_canvasPainter->isActive())
@@ -111,7 +162,7 @@ void RenderingContext::updateZoomFactor(qreal diff, QPoint center) {
         return;
 
     qreal oldZoomFactor = m_zoomFactor;
-    m_zoomFactor += diff * 0.1;
+    setZoomFactor(m_zoomFactor + diff * 0.1);
 
     qDebug() << "Zoom: " << m_zoomFactor;
 
@@ -133,7 +184,8 @@ void RenderingContext::updateZoomFactor(qreal diff, QPoint center) {
     endPainters();
     beginPainters();
 
-    m_applicationContext->spatialContext().cacheGrid().markAllDirty();
+    // the cached cells stay valid, they are keyed by zoom level
+    m_zoomTimer.start();
 
     m_applicationContext->renderingContext().markForRender();
     m_applicationContext->renderingContext().markForUpdate();
@@ -141,6 +193,19 @@ void RenderingContext::updateZoomFactor(qreal diff, QPoint center) {
 
 void RenderingContext::setZoomFactor(qreal newValue) {
     m_zoomFactor = newValue;
+    m_applicationContext->spatialContext().cacheGrid().setZoomFactor(newValue);
+}
+
+bool RenderingContext::zooming() const {
+    return m_zoomTimer.isActive();
+}
+
+int RenderingContext::frameBudget() const {
+    return m_frameBudget;
+}
+
+QPointF RenderingContext::panVelocity() const {
+    return m_panVelocity;
 }
 
 const int RenderingContext::fps() const {
@@ -153,27 +218,102 @@ const int RenderingContext::fps() const {
 }
 
 void RenderingContext::canvasResized() {
-    int width{m_canvas->dimensions().width()}, height{m_canvas->dimensions().height()};
+    // Cells have a fixed size in device pixels, so their images take the same memory at any
+    // ratio, but a screen shows ratio squared times as many of them. The ratio is read from
+    // the widget, the canvas only takes it over after this signal.
+    qreal ratio{m_canvas->devicePixelRatioF()};
+    double width{m_canvas->width() * ratio}, height{m_canvas->height() * ratio};
     int cellW{CacheCell::cellSize().width()}, cellH{CacheCell::cellSize().height()};
-    int rows{static_cast<int>(std::ceil(height / static_cast<double>(cellH)) + 1)};
-    int cols{static_cast<int>(std::ceil(width / static_cast<double>(cellW)) + 1)};
+    int rows{static_cast<int>(std::ceil(height / cellH) + 1)};
+    int cols{static_cast<int>(std::ceil(width / cellW) + 1)};
+
+    // a zoom is drawn from a level up to twice as large; room for nine screens of cells
+    // within the budget, but never less than what one screen needs
+    qsizetype visibleBytes{4 * rows * cols * CacheCell::imageBytes()};
+    qsizetype budget{std::min(9 * visibleBytes, CacheGrid::budgetFromEnvironment())};
 
-    m_applicationContext->spatialContext().cacheGrid().setSize(9 * rows * cols);
+    m_applicationContext->spatialContext().cacheGrid().setBudget(std::max(budget, visibleBytes));
+}
+
+bool RenderingContext::debugOverlay() const {
+    return m_debugOverlay;
+}
+
+void RenderingContext::toggleDebugOverlay() {
+    m_debugOverlay = !m_debugOverlay;
+
+    // the counters should only cover the frames drawn with the overlay
+    m_applicationContext->spatialContext().spatialIndex().resetQueryCost();
+
+    markForRender();
+    markForUpdate();
 }
 
 void RenderingContext::markForRender() {
     m_needsReRender = true;
+    scheduleFrame();
 }
 
 void RenderingContext::markForUpdate() {
     m_needsUpdate = true;
+    scheduleFrame();
 }
 
-void RenderingContext::markForUpdate(const QRect &region) {
-    m_needsUpdate = true;
-    m_updateRegion = region;
+void RenderingContext::markForUpdate(const QRect &rect) {
+    m_updateRegion += rect;
+    scheduleFrame();
+}
+
+void RenderingContext::markForUpdate(const QRegion &region) {
+    m_updateRegion += region;
+    scheduleFrame();
 }
 
 void RenderingContext::reset() {
     setZoomFactor(1.0);
 }
+
+// PRIVATE
+void RenderingContext::scheduleFrame() {
+    if (!m_canvas) {
+        return;
+    }
+
+    // panning, dragging and typing all ask for frames, so the user isn't idle yet
+    m_applicationContext->spatialContext().postponeCompaction();
+
+    // everything marked until the frame runs, or while it runs, is handled by it
+    if (m_inFrame || m_frameTimer.isActive()) {
+        return;
+    }
+
+    // right away after a pause, but while input keeps coming at most once per screen refresh
+    qint64 interval{1000 / std::max(fps(), 1)};
+    qint64 sinceLastFrame{m_lastFrame.isValid() ? m_lastFrame.elapsed() : interval};
+    m_frameTimer.start(static_cast<int>(std::max<qint64>(interval - sinceLastFrame, 0)));
+}
+
+void RenderingContext::updatePanVelocity() {
+    QPointF offsetPos{m_applicationContext->spatialContext().offsetPos()};
+
+    // zooming moves the offset as well, which isn't panning
+    if (!m_panTimer.isValid() || m_lastPanZoomFactor != m_zoomFactor) {
+        m_panVelocity = QPointF{};
+        m_panTimer.start();
+    } else {
+        qint64 elapsed{m_panTimer.elapsed()};
+        if (elapsed == 0) {
+            return;
+        }
+
+        QPointF velocity{(offsetPos - m_lastOffsetPos) * 1000.0 / elapsed};
+        m_panTimer.restart();
+
+        // after a pause the old velocity says nothing anymore
+        bool paused{elapsed > Common::panSmoothingWindow};
+        m_panVelocity = paused ? velocity : (m_panVelocity + velocity) / 2;
+    }
+
+    m_lastOffsetPos = offsetPos;
+    m_lastPanZoomFactor = m_zoomFactor;
+}
@@ -18,6 +18,8 @@
 
 #pragma once
 
+#include <QElapsedTimer>
+#include <QRegion>
 #include <QTimer>
 #include <QWidget>
 class Canvas;
@@ -28,6 +30,16 @@ class RenderingContext : public QObject {
     Q_OBJECT
 
 public:
+    // what the canvas shows, so that a pan can scroll it instead of composing it again
+    struct Composition {
+        bool valid{false};
+        qreal zoomFactor{0};
+        QPointF gridOffset{};
+        QSize size{};
+        QColor background{};
+        QRect decorations{};  // drawn over the cells, like the selection boxes
+    };
+
     RenderingContext(ApplicationContext *context);
     ~RenderingContext();
 
@@ -37,16 +49,36 @@ public:
     QPainter &canvasPainter() const;
     QPainter &overlayPainter() const;
 
+    Composition &composition();
+
+    // moves the pixels of the canvas inside the rect, returns the region left uncovered
+    QRegion scrollCanvas(const QPoint &delta, const QRect &rect);
+
     void markForRender();
+    // regions are in canvas pixels and add up until the next frame repaints them
     void markForUpdate();
-    void markForUpdate(const QRect &region);
+    void markForUpdate(const QRect &rect);
+    void markForUpdate(const QRegion &region);
 
     qreal zoomFactor() const;
     void setZoomFactor(qreal newValue);
     void updateZoomFactor(qreal diff, QPoint center = {-1, -1});
 
+    // the zoom changed moments ago, cells other levels can stand in for aren't rendered yet
+    bool zooming() const;
+
     const int fps() const;
 
+    // milliseconds a frame may spend on rendering cells, the rest is left for later frames
+    int frameBudget() const;
+
+    // how fast the view is being panned, in world units per second, smoothed over frames
+    QPointF panVelocity() const;
+
+    // draws the spatial index and how much work its queries do over the canvas
+    bool debugOverlay() const;
+    void toggleDebugOverlay();
+
     void reset();
 
 private slots:
@@ -55,17 +87,31 @@ private slots:
     void canvasResized();
 
 private:
+    void scheduleFrame();
+    void updatePanVelocity();
+
     Canvas *m_canvas{nullptr};
     QPainter *m_canvasPainter{};
     QPainter *m_overlayPainter{};
 
     QTimer m_frameTimer;
+    QElapsedTimer m_lastFrame{};
+    QTimer m_zoomTimer;
 
     bool m_needsReRender{false};
     bool m_needsUpdate{false};
-    QRect m_updateRegion{};
+    QRegion m_updateRegion{};
+    bool m_inFrame{false};
+    Composition m_composition{};
 
     qreal m_zoomFactor{1};
+    int m_frameBudget{0};
+
+    QElapsedTimer m_panTimer{};
+    QPointF m_lastOffsetPos{};
+    qreal m_lastPanZoomFactor{0};
+    QPointF m_panVelocity{};
+    bool m_debugOverlay{false};
 
     ApplicationContext *m_applicationContext;
 };
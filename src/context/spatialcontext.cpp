@@ -20,13 +20,13 @@
 
 #include <memory>
 
-#include "../canvas/canvas.hpp"
 #include "../command/commandhistory.hpp"
+#include "../common/constants.hpp"
 #include "../data-structures/cachegrid.hpp"
-#include "../data-structures/quadtree.hpp"
+#include "../data-structures/orderedlist.hpp"
+#include "../data-structures/spatialindex.hpp"
 #include "applicationcontext.hpp"
 #include "coordinatetransformer.hpp"
-#include "renderingcontext.hpp"
 
 SpatialContext::SpatialContext(ApplicationContext *context)
     : QObject{context},
@@ -38,16 +38,38 @@ SpatialContext::~SpatialContext() {
 }
 
 void SpatialContext::setSpatialContext() {
-    Canvas &canvas{m_applicationContext->renderingContext().canvas()};
+    // the backend can be picked for a deployment, see SpatialIndex::create
+    m_spatialIndex = SpatialIndex::create(qEnvironmentVariable("DRAWY_SPATIAL_INDEX"),
+                                          SpatialIndex::Settings::fromEnvironment());
+    qDebug() << "Spatial index:" << m_spatialIndex->name();
 
-    m_quadtree = std::make_unique<QuadTree>(QRect{{0, 0}, canvas.sizeHint()}, 100);
     m_coordinateTransformer = std::make_unique<CoordinateTransformer>(m_applicationContext);
-    m_cacheGrid = std::make_unique<CacheGrid>(100);
+    m_cacheGrid = std::make_unique<CacheGrid>(CacheGrid::budgetFromEnvironment());
     m_commandHistory = std::make_unique<CommandHistory>(m_applicationContext);
+
+    m_compactionTimer.setSingleShot(true);
+    m_compactionTimer.setInterval(Common::spatialIndexCompactionDelay);
+
+    QObject::connect(&m_compactionTimer, &QTimer::timeout, this, [&]() {
+        if (m_spatialIndex->fragmented()) {
+            m_spatialIndex->compact();
+        }
+    });
+}
+
+void SpatialContext::scheduleCompaction() {
+    m_compactionTimer.start();
+}
+
+void SpatialContext::postponeCompaction() {
+    // a rebuild of the index must not stall an interaction which is still going on
+    if (m_compactionTimer.isActive()) {
+        m_compactionTimer.start();
+    }
 }
 
-QuadTree &SpatialContext::quadtree() const {
-    return *m_quadtree;
+SpatialIndex &SpatialContext::spatialIndex() const {
+    return *m_spatialIndex;
 }
 
 CacheGrid &SpatialContext::cacheGrid() const {
@@ -71,7 +93,8 @@ void SpatialContext::setOffsetPos(const QPointF &pos) {
 }
 
 void SpatialContext::reset() {
-    quadtree().clear();
+    spatialIndex().clear();
+    spatialIndex().orderedList().clear();
     cacheGrid().markAllDirty();
     commandHistory().clear();
     setOffsetPos(QPointF{0, 0});
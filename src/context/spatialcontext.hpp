@@ -18,8 +18,9 @@
 
 #pragma once
 
+#include <QTimer>
 #include <QWidget>
-class QuadTree;
+class SpatialIndex;
 class CacheGrid;
 class CoordinateTransformer;
 class ApplicationContext;
@@ -34,7 +35,7 @@ public:
     void setSpatialContext();
 
     // SpatialContext
-    QuadTree &quadtree() const;
+    SpatialIndex &spatialIndex() const;
     CacheGrid &cacheGrid() const;
     CoordinateTransformer &coordinateTransformer() const;
     CommandHistory &commandHistory() const;
@@ -44,12 +45,19 @@ public:
 
     void reset();
 
+    // compacts the spatial index once the user has been idle for a while, anything drawn
+    // in the meantime postpones it
+    void scheduleCompaction();
+    void postponeCompaction();
+
 private:
-    std::unique_ptr<QuadTree> m_quadtree{nullptr};
+    std::unique_ptr<SpatialIndex> m_spatialIndex{nullptr};
     std::unique_ptr<CacheGrid> m_cacheGrid{nullptr};
     std::unique_ptr<CoordinateTransformer> m_coordinateTransformer{nullptr};
     std::unique_ptr<CommandHistory> m_commandHistory{nullptr};
 
+    QTimer m_compactionTimer;
+
     // Stores the position of the topleft corner of the viewport with respect to
     // to the world center. If viewport moves down/right, the coordinates increase
     QPointF m_offsetPos{};
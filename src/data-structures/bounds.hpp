@@ -0,0 +1,126 @@
+/*
+ * Drawy - A simple brainstorming tool with an infinite canvas
+ * Copyright (C) 2025 - Prayag Jain <prayagjain2@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QLineF>
+#include <QPointF>
+#include <QRectF>
+#include <algorithm>
+
+#include "../common/utils/math.hpp"
+
+/*
+ * A plain axis aligned bounding box.
+ * The spatial data structures keep these next to their item handles, so overlap
+ * tests are done on four numbers without calling into the item itself.
+ */
+struct Bounds {
+    qreal left{};
+    qreal top{};
+    qreal right{};
+    qreal bottom{};
+
+    Bounds() = default;
+
+    Bounds(qreal x1, qreal y1, qreal x2, qreal y2) : left{x1}, top{y1}, right{x2}, bottom{y2} {
+    }
+
+    explicit Bounds(const QRectF &rect) {
+        QRectF normalized{rect.normalized()};
+        left = normalized.left();
+        top = normalized.top();
+        right = normalized.right();
+        bottom = normalized.bottom();
+    }
+
+    explicit Bounds(const QPointF &point)
+        : left{point.x()},
+          top{point.y()},
+          right{point.x()},
+          bottom{point.y()} {
+    }
+
+    explicit Bounds(const QLineF &line) : Bounds{QRectF{line.p1(), line.p2()}} {
+    }
+
+    QRectF toRect() const {
+        return QRectF{QPointF{left, top}, QPointF{right, bottom}};
+    }
+
+    // touching edges do not count, same as QRectF::intersects
+    bool intersects(const Bounds &other) const {
+        return left < other.right && other.left < right && top < other.bottom &&
+               other.top < bottom;
+    }
+
+    // touching edges count, which is what deciding whether a node needs visiting takes,
+    // since a point on the edge of a box intersects it
+    bool overlaps(const Bounds &other) const {
+        return left <= other.right && other.left <= right && top <= other.bottom &&
+               other.top <= bottom;
+    }
+
+    bool intersects(const QRectF &rect) const {
+        return intersects(Bounds{rect});
+    }
+
+    // points on the edges count, same as QRectF::contains
+    bool intersects(const QPointF &point) const {
+        return point.x() >= left && point.x() <= right && point.y() >= top &&
+               point.y() <= bottom;
+    }
+
+    bool intersects(const QLineF &line) const {
+        return Common::Utils::Math::intersects(toRect(), line);
+    }
+
+    Bounds united(const Bounds &other) const {
+        return Bounds{std::min(left, other.left),
+                      std::min(top, other.top),
+                      std::max(right, other.right),
+                      std::max(bottom, other.bottom)};
+    }
+
+    // area of the part shared with the other box, zero if they are apart
+    qreal overlapArea(const Bounds &other) const {
+        qreal width{std::min(right, other.right) - std::max(left, other.left)};
+        qreal height{std::min(bottom, other.bottom) - std::max(top, other.top)};
+        return width > 0 && height > 0 ? width * height : 0;
+    }
+
+    qreal area() const {
+        return (right - left) * (bottom - top);
+    }
+
+    // half the perimeter
+    qreal margin() const {
+        return (right - left) + (bottom - top);
+    }
+
+    Bounds adjusted(qreal margin) const {
+        return Bounds{left - margin, top - margin, right + margin, bottom + margin};
+    }
+
+    bool operator==(const Bounds &other) const = default;
+
+    bool contains(const Bounds &other) const {
+        return other.left >= left && other.right <= right && other.top >= top &&
+               other.bottom <= bottom;
+    }
+};
@@ -19,37 +19,36 @@
 #include "cachegrid.hpp"
 
 #include <QDebug>
-#include <QPainter>
+#include <algorithm>
+#include <cmath>
 
-int CacheCell::counter = 0;
-
-CacheCell::CacheCell(const QPoint &point) : m_point{point} {
-    m_image = std::make_unique<QPixmap>(CacheCell::cellSize());
-    m_image->fill(Qt::transparent);
+#include "../common/constants.hpp"
 
-    m_painter = std::make_unique<QPainter>(m_image.get());
-    m_painter->setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform);
-    m_painter->setCompositionMode(QPainter::CompositionMode_SourceOver);
-    m_painter->setClipRegion(m_image->rect());
+int CacheCell::counter = 0;
 
+CacheCell::CacheCell(int level, const QPoint &point) : m_level{level}, m_point{point} {
     CacheCell::counter++;
-    m_dirty = true;
+    setDirty(true);
 }
 
 CacheCell::~CacheCell() {
     CacheCell::counter--;
 }
 
+int CacheCell::level() const {
+    return m_level;
+}
+
 const QPoint &CacheCell::point() const {
     return m_point;
 }
 
 bool CacheCell::dirty() const {
-    return m_dirty;
+    return !m_dirtyRegion.isEmpty();
 }
 
-QPixmap &CacheCell::image() const {
-    return *m_image;
+const QImage &CacheCell::image() const {
+    return m_image;
 }
 
 QRect CacheCell::rect() const {
@@ -58,33 +57,44 @@ QRect CacheCell::rect() const {
     return {cellPos.x(), cellPos.y(), cellW, cellH};
 }
 
+QRectF CacheCell::worldRect() const {
+    qreal scale{CacheGrid::levelScale(m_level)};
+    QRectF levelRect{rect()};
+    return {levelRect.topLeft() / scale, levelRect.size() / scale};
+}
+
 void CacheCell::setDirty(bool dirty) {
-    m_dirty = dirty;
+    m_dirtyRegion = dirty ? QRegion{QRect{QPoint{0, 0}, cellSize()}} : QRegion{};
 }
 
-QPainter &CacheCell::painter() const {
-    return *m_painter;
+const QRegion &CacheCell::dirtyRegion() const {
+    return m_dirtyRegion;
+}
+
+void CacheCell::markDirty(const QRect &rect) {
+    m_dirtyRegion += rect & QRect{QPoint{0, 0}, cellSize()};
 }
 
 QSize CacheCell::cellSize() {
     return {500, 500};
 }
 
-CacheGrid::CacheGrid(int maxSize) {
+qsizetype CacheCell::imageBytes() {
+    return qsizetype{cellSize().width()} * cellSize().height() * 4;
+}
+
+CacheGrid::CacheGrid(qsizetype budget) {
     m_headCell->nextCell = m_tailCell;
     m_tailCell->prevCell = m_headCell;
 
-    if (maxSize == 0) {
-        throw std::logic_error("maxSize can not be zero for the cache grid");
-    }
-    m_maxSize = maxSize;
+    setBudget(budget);
 }
 
 CacheGrid::~CacheGrid() {
     qDebug() << "Object deleted: CacheGrid";
 }
 
-QVector<std::shared_ptr<CacheCell>> CacheGrid::queryCells(const QRect &rect) {
+QVector<std::shared_ptr<CacheCell>> CacheGrid::queryCells(int level, const QRect &rect) {
     QPoint topLeft{rect.topLeft()}, bottomRight{rect.bottomRight()};
 
     int cellMinX = floor(static_cast<double>(topLeft.x()) / CacheCell::cellSize().width());
@@ -95,41 +105,124 @@ QVector<std::shared_ptr<CacheCell>> CacheGrid::queryCells(const QRect &rect) {
     QVector<std::shared_ptr<CacheCell>> out{};
     for (int row = cellMinX; row <= cellMaxX; row++) {
         for (int col = cellMinY; col <= cellMaxY; col++) {
-            out.push_back(cell(QPoint{row, col}));
+            out.push_back(cell(level, QPoint{row, col}));
         }
     }
 
     return out;
 }
 
+QVector<std::shared_ptr<CacheCell>> CacheGrid::standInCells(const CacheCell &cell) const {
+    int cellW{CacheCell::cellSize().width()}, cellH{CacheCell::cellSize().height()};
+    QRectF worldRect{cell.worldRect()};
+
+    // the level above is tried first as it is the sharper one
+    for (int distance{1}; distance <= Common::cacheGridStandInLevels; distance++) {
+        for (int level : {cell.level() + distance, cell.level() - distance}) {
+            qreal scale{levelScale(level)};
+            QRectF levelRect{worldRect.topLeft() * scale, worldRect.size() * scale};
+
+            // the levels differ by powers of two, so cell edges line up exactly
+            int minX{static_cast<int>(std::floor(levelRect.left() / cellW))};
+            int minY{static_cast<int>(std::floor(levelRect.top() / cellH))};
+            int maxX{static_cast<int>(std::ceil(levelRect.right() / cellW)) - 1};
+            int maxY{static_cast<int>(std::ceil(levelRect.bottom() / cellH)) - 1};
+
+            QVector<std::shared_ptr<CacheCell>> out{};
+            bool covered{true};
+            for (int x{minX}; x <= maxX && covered; x++) {
+                for (int y{minY}; y <= maxY && covered; y++) {
+                    std::shared_ptr<CacheCell> standIn{m_grid.value(Key{level, QPoint{x, y}})};
+                    covered = standIn && !standIn->dirty();
+                    out.push_back(standIn);
+                }
+            }
+
+            if (covered) {
+                return out;
+            }
+        }
+    }
+
+    return {};
+}
+
 void CacheGrid::markDirty(const QRect &rect) {
-    QVector<std::shared_ptr<CacheCell>> dirtyCells{queryCells(rect)};
-    for (std::shared_ptr<CacheCell> cell : dirtyCells) {
-        cell->setDirty(true);
+    int cellW{CacheCell::cellSize().width()}, cellH{CacheCell::cellSize().height()};
+    QRectF gridRect{rect.normalized()};
+    QRectF worldRect{gridRect.topLeft() / m_zoomFactor, gridRect.size() / m_zoomFactor};
+
+    // only the covered pixels of the cell, with a margin for antialiasing and rounding
+    constexpr int margin{2};
+    auto markCell = [&](CacheCell &cell, qreal scale) {
+        QRectF pixels{(worldRect.topLeft() - cell.worldRect().topLeft()) * scale,
+                      worldRect.size() * scale};
+        cell.markDirty(pixels.toAlignedRect().adjusted(-margin, -margin, margin, margin));
+    };
+
+    for (const auto &[level, count] : m_levelCells) {
+        qreal scale{levelScale(level)};
+        QRectF levelRect{worldRect.topLeft() * scale, worldRect.size() * scale};
+
+        // cells touching the rect count as well, which catches rects without an area
+        int minX{static_cast<int>(std::ceil(levelRect.left() / cellW)) - 1};
+        int minY{static_cast<int>(std::ceil(levelRect.top() / cellH)) - 1};
+        int maxX{static_cast<int>(std::floor(levelRect.right() / cellW))};
+        int maxY{static_cast<int>(std::floor(levelRect.bottom() / cellH))};
+
+        // the cells are looked up, unless there are fewer of them at this level than that
+        qint64 covered{(qint64{maxX} - minX + 1) * (qint64{maxY} - minY + 1)};
+        if (covered > count) {
+            for (const auto &cell : m_grid) {
+                const QPoint &point{cell->point()};
+                if (cell->level() == level && point.x() >= minX && point.x() <= maxX &&
+                    point.y() >= minY && point.y() <= maxY) {
+                    markCell(*cell, scale);
+                }
+            }
+            continue;
+        }
+
+        for (int x{minX}; x <= maxX; x++) {
+            for (int y{minY}; y <= maxY; y++) {
+                auto found{m_grid.constFind(Key{level, QPoint{x, y}})};
+                if (found != m_grid.cend()) {
+                    markCell(**found, scale);
+                }
+            }
+        }
     }
 }
 
-std::shared_ptr<CacheCell> CacheGrid::cell(const QPoint &point) {
+void CacheGrid::protectCells(const QVector<std::shared_ptr<CacheCell>> &cells) {
+    for (auto cell : m_protectedCells) {
+        cell->m_protected = false;
+    }
+
+    m_protectedCells = cells;
+    for (auto cell : m_protectedCells) {
+        cell->m_protected = true;
+    }
+}
+
+void CacheGrid::setZoomFactor(qreal zoomFactor) {
+    m_zoomFactor = zoomFactor;
+}
+
+std::shared_ptr<CacheCell> CacheGrid::cell(int level, const QPoint &point) {
+    Key key{level, point};
     std::shared_ptr<CacheCell> cur{};
-    if (!m_grid.contains(point) || !m_grid[point]) {
-        if (m_curSize == m_maxSize) {
-            // deleting least recently used cell
-            std::shared_ptr<CacheCell> temp{m_headCell->nextCell};
-            m_headCell->nextCell = temp->nextCell;
-            if (auto next = temp->nextCell.lock()) {
-                next->prevCell = m_headCell;
-            }
-            m_grid[temp->point()] = nullptr;
-            m_grid.remove(temp->point());
-            temp.reset();
-            m_curSize--;
+    if (!m_grid.contains(key) || !m_grid[key]) {
+        while (m_curSize - m_cellImages >= Common::cacheGridEmptyCells &&
+               evictLeastRecent(false)) {
         }
 
-        cur = std::make_shared<CacheCell>(point);
-        m_grid[point] = cur;
+        cur = std::make_shared<CacheCell>(level, point);
+        m_grid[key] = cur;
+        m_levelCells[level]++;
         m_curSize++;
     } else {
-        cur = m_grid[point];
+        cur = m_grid[key];
         if (auto prev = cur->prevCell.lock()) {
             prev->nextCell = cur->nextCell;
         }
@@ -151,12 +244,161 @@ int CacheGrid::size() const {
     return m_curSize;
 }
 
-void CacheGrid::setSize(int newSize) {
-    m_maxSize = newSize;
+qsizetype CacheGrid::budget() const {
+    return m_budget;
+}
+
+qsizetype CacheGrid::heldBytes() const {
+    return (m_cellImages + m_lentImages + m_freeImages.size()) * CacheCell::imageBytes();
+}
+
+void CacheGrid::setBudget(qsizetype budget) {
+    if (budget < CacheCell::imageBytes()) {
+        throw std::logic_error("the budget of the cache grid must fit at least one cell");
+    }
+
+    m_budget = budget;
+    trimToBudget();
+}
+
+QImage CacheGrid::acquireImage(CacheCell &cell) {
+    if (!cell.m_image.isNull()) {
+        // moved out, so that painting on it doesn't detach a copy
+        m_cellImages--;
+        m_lentImages++;
+        QImage image{std::move(cell.m_image)};
+        cell.m_image = QImage{};
+        return image;
+    }
+
+    // at the budget, the least recently used cell gives up its image instead
+    if (m_freeImages.empty() && heldBytes() + CacheCell::imageBytes() > m_budget) {
+        evictLeastRecent(true);
+    }
+
+    m_lentImages++;
+    if (!m_freeImages.empty()) {
+        QImage image{std::move(m_freeImages.back())};
+        m_freeImages.pop_back();
+        return image;
+    }
+
+    // unlike a QPixmap, a QImage can be painted on outside the GUI thread
+    return QImage{CacheCell::cellSize(), QImage::Format_ARGB32_Premultiplied};
+}
+
+void CacheGrid::storeImage(CacheCell &cell, QImage image) {
+    m_lentImages--;
+
+    // the cell may have been evicted while it was rendered
+    if (m_grid.value(Key{cell.level(), cell.point()}).get() != &cell) {
+        recycleImage(std::move(image));
+        return;
+    }
+
+    if (cell.m_image.isNull() && !image.isNull()) {
+        m_cellImages++;
+    } else if (!cell.m_image.isNull() && image.isNull()) {
+        m_cellImages--;
+    }
+    cell.m_image = std::move(image);
+
+    trimToBudget();
+}
+
+void CacheGrid::releaseImage(CacheCell &cell) {
+    if (cell.m_image.isNull()) {
+        return;
+    }
+
+    m_cellImages--;
+    recycleImage(std::move(cell.m_image));
+    cell.m_image = QImage{};
+}
+
+qsizetype CacheGrid::budgetFromEnvironment() {
+    bool ok{false};
+    qsizetype megabytes{qEnvironmentVariable("DRAWY_CACHE_BUDGET_MB").toLongLong(&ok)};
+    if (!ok || megabytes <= 0) {
+        megabytes = Common::cacheGridBudget;
+    }
+
+    return std::max(megabytes * 1024 * 1024, CacheCell::imageBytes());
+}
+
+int CacheGrid::levelFor(qreal zoomFactor) {
+    // so that rounding errors in the zoom factor don't bump it to the next level
+    constexpr qreal tolerance{1e-6};
+    return static_cast<int>(std::ceil(std::log2(zoomFactor) - tolerance));
+}
+
+qreal CacheGrid::levelScale(int level) {
+    return std::ldexp(1.0, level);
+}
+
+// PRIVATE
+bool CacheGrid::evictLeastRecent(bool withImage) {
+    // protected cells are passed over, unless there is nothing else left
+    std::shared_ptr<CacheCell> victim{};
+    for (auto cur{m_headCell->nextCell.lock()}; cur != m_tailCell; cur = cur->nextCell.lock()) {
+        if (cur->m_image.isNull() == withImage) {
+            continue;
+        }
+
+        if (!victim) {
+            victim = cur;
+        }
+        if (!cur->m_protected) {
+            victim = cur;
+            break;
+        }
+    }
+
+    if (!victim) {
+        return false;
+    }
+
+    if (auto prev = victim->prevCell.lock()) {
+        prev->nextCell = victim->nextCell;
+    }
+    if (auto next = victim->nextCell.lock()) {
+        next->prevCell = victim->prevCell;
+    }
+    m_grid.remove(Key{victim->level(), victim->point()});
+    if (--m_levelCells[victim->level()] == 0) {
+        m_levelCells.erase(victim->level());
+    }
+    m_curSize--;
+
+    if (!victim->m_image.isNull()) {
+        m_cellImages--;
+        recycleImage(std::move(victim->m_image));
+        victim->m_image = QImage{};
+    }
+
+    return true;
+}
+
+void CacheGrid::recycleImage(QImage image) {
+    // the free images count against the budget as well
+    if (image.isNull() || heldBytes() + CacheCell::imageBytes() > m_budget) {
+        return;
+    }
+
+    m_freeImages.push_back(std::move(image));
+}
+
+void CacheGrid::trimToBudget() {
+    // free images go first, then the images of the least recently used cells
+    while (heldBytes() > m_budget && !m_freeImages.empty()) {
+        m_freeImages.pop_back();
+    }
+    while (heldBytes() > m_budget && evictLeastRecent(true)) {
+    }
 }
 
 void CacheGrid::markAllDirty() {
-    for (auto cell : m_grid) {
+    for (const auto &cell : m_grid) {
         cell->setDirty(true);
     }
 }
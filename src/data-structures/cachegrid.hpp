@@ -18,34 +18,48 @@
 
 #pragma once
 #include <QHash>
-#include <QPixmap>
+#include <QImage>
 #include <QPoint>
+#include <QRegion>
+#include <map>
+#include <memory>
 
 class CacheGrid;
 
-// Based on LRU cache
+// Based on LRU cache, holds the cells of every zoom level
 class CacheCell {
 public:
     static QSize cellSize();
+    static qsizetype imageBytes();  // memory held by the image of a rendered cell
     static int counter;
 
-    CacheCell(const QPoint &point);
+    CacheCell(int level, const QPoint &point);
     ~CacheCell();
 
+    // in the pixels of the cell's level, see CacheGrid::levelFor
     QRect rect() const;
+    QRectF worldRect() const;
+    int level() const;
     const QPoint &point() const;
     bool dirty() const;
     void setDirty(bool dirty);
-    QPixmap &image() const;
-    QPainter &painter() const;
+
+    // the part which has to be rendered again, in the cell's own pixels starting at 0, 0
+    const QRegion &dirtyRegion() const;
+    void markDirty(const QRect &rect);
+
+    // null until the cell is rendered, and for cells without any items, see
+    // CacheGrid::storeImage
+    const QImage &image() const;
 
 private:
+    int m_level{0};
     QPoint m_point{};
-    std::unique_ptr<QPixmap> m_image{nullptr};
-    std::unique_ptr<QPainter> m_painter{};
+    QImage m_image{};
     std::weak_ptr<CacheCell> nextCell{};
     std::weak_ptr<CacheCell> prevCell{};
-    bool m_dirty{};
+    QRegion m_dirtyRegion{};
+    bool m_protected{};
 
     // CacheGrid can access private members
     friend CacheGrid;
@@ -53,22 +67,77 @@ private:
 
 class CacheGrid {
 public:
-    CacheGrid(int maxSize);
+    // the budget is in bytes and covers the images of the cells, the ones being rendered and
+    // the free ones; cells without an image are limited by count, see cacheGridEmptyCells
+    CacheGrid(qsizetype budget);
     ~CacheGrid();
 
-    QVector<std::shared_ptr<CacheCell>> queryCells(const QRect &rect);
-    std::shared_ptr<CacheCell> cell(const QPoint &point);
+    QVector<std::shared_ptr<CacheCell>> queryCells(int level, const QRect &rect);
+    std::shared_ptr<CacheCell> cell(int level, const QPoint &point);
+
+    // clean cells of the nearest other level which together cover the cell, so that they can
+    // be scaled to stand in for it; empty if no level within reach covers all of it
+    QVector<std::shared_ptr<CacheCell>> standInCells(const CacheCell &cell) const;
+
+    // the cells are evicted only after every other one, until other cells are protected
+    void protectCells(const QVector<std::shared_ptr<CacheCell>> &cells);
+
+    // the rect is in grid coordinates of the current zoom, cells of every level are marked
     void markDirty(const QRect &rect);
     void markAllDirty();
-    void setSize(int newSize);
+    void setZoomFactor(qreal zoomFactor);
+    void setBudget(qsizetype budget);
+    qsizetype budget() const;
+    qsizetype heldBytes() const;
     int size() const;
 
+    // an image to render the cell into, its old image or one left behind by an evicted
+    // cell when there is one, so that panning doesn't allocate; the contents are undefined
+    // and the image has to be handed back with storeImage
+    QImage acquireImage(CacheCell &cell);
+
+    // gives the rendered image to the cell, the least recently used images are evicted
+    // when it doesn't fit the budget anymore
+    void storeImage(CacheCell &cell, QImage image);
+
+    // frees the image of a cell which turned out to be empty
+    void releaseImage(CacheCell &cell);
+
+    // the budget set with DRAWY_CACHE_BUDGET_MB, or the default one
+    static qsizetype budgetFromEnvironment();
+
+    // cells are rendered at power of two zoom factors, the level is the exponent; a zoom is
+    // drawn from the level at or above it, so switching back to a zoom finds its cells again
+    static int levelFor(qreal zoomFactor);
+    static qreal levelScale(int level);
+
 private:
-    QHash<QPoint, std::shared_ptr<CacheCell>> m_grid{};
-    std::shared_ptr<CacheCell> m_headCell{std::make_shared<CacheCell>(QPoint{0, 0})};
-    std::shared_ptr<CacheCell> m_tailCell{std::make_shared<CacheCell>(QPoint{0, 0})};
+    struct Key {
+        int level;
+        QPoint point;
+
+        bool operator==(const Key &other) const = default;
+        friend size_t qHash(const Key &key, size_t seed = 0) {
+            return qHashMulti(seed, key.level, key.point);
+        }
+    };
+
+    // false when there is no cell with or without an image left
+    bool evictLeastRecent(bool withImage);
+    void recycleImage(QImage image);
+    void trimToBudget();
+
+    QHash<Key, std::shared_ptr<CacheCell>> m_grid{};
+    std::map<int, int> m_levelCells{};  // number of cells of every level in the grid
+    std::shared_ptr<CacheCell> m_headCell{std::make_shared<CacheCell>(0, QPoint{0, 0})};
+    std::shared_ptr<CacheCell> m_tailCell{std::make_shared<CacheCell>(0, QPoint{0, 0})};
+
+    QVector<QImage> m_freeImages{};
+    QVector<std::shared_ptr<CacheCell>> m_protectedCells{};
 
-    QSize m_cellSize{};
+    qreal m_zoomFactor{1};
+    qsizetype m_budget{0};
     int m_curSize{0};
-    int m_maxSize{0};
+    int m_cellImages{0};  // cells in the grid which hold an image
+    int m_lentImages{0};  // acquired and not stored yet
 };
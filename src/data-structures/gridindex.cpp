@@ -0,0 +1,426 @@
+/*
+ * Drawy - A simple brainstorming tool with an infinite canvas
+ * Copyright (C) 2025 - Prayag Jain <prayagjain2@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gridindex.hpp"
+
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+#include "../common/constants.hpp"
+#include "../item/item.hpp"
+#include "orderedlist.hpp"
+
+GridIndex::GridIndex(qreal cellSize) : GridIndex{cellSize, std::make_shared<OrderedList>()} {
+}
+
+GridIndex::GridIndex(qreal cellSize, std::shared_ptr<OrderedList> orderedList)
+    : SpatialIndex{orderedList},
+      m_cellSize{cellSize} {
+    reset();
+}
+
+GridIndex::~GridIndex() {
+    qDebug() << "Object deleted: GridIndex";
+}
+
+void GridIndex::reset() {
+    m_cells = {};
+    m_freeCells = {};
+    m_cellIndex.clear();
+    m_cells.push_back(Cell{});
+}
+
+QPoint GridIndex::cellAt(const QPointF &point) const {
+    // clamped, so that absurdly far away points do not overflow, items out there cover
+    // too many cells and end up with the large ones
+    constexpr qreal limit{1 << 29};
+
+    qreal x{std::clamp(std::floor(point.x() / m_cellSize), -limit, limit)};
+    qreal y{std::clamp(std::floor(point.y() / m_cellSize), -limit, limit)};
+
+    return QPoint{static_cast<int>(x), static_cast<int>(y)};
+}
+
+QRect GridIndex::cellsAround(const Bounds &bounds) const {
+    return QRect{cellAt(QPointF{bounds.left, bounds.top}),
+                 cellAt(QPointF{bounds.right, bounds.bottom})};
+}
+
+int GridIndex::cellFor(const QPoint &key) {
+    auto it{m_cellIndex.constFind(key)};
+    if (it != m_cellIndex.cend()) {
+        return it.value();
+    }
+
+    int cell{};
+    if (m_freeCells.empty()) {
+        cell = static_cast<int>(m_cells.size());
+        m_cells.push_back(Cell{});
+    } else {
+        cell = m_freeCells.back();
+        m_freeCells.pop_back();
+    }
+
+    m_cells[cell].key = key;
+    m_cellIndex.insert(key, cell);
+    return cell;
+}
+
+void GridIndex::releaseCell(int cell) {
+    m_cellIndex.remove(m_cells[cell].key);
+    m_cells[cell] = Cell{};
+    m_freeCells.push_back(cell);
+}
+
+int GridIndex::acquireEntry(std::shared_ptr<Item> item) {
+    int handle{};
+    if (m_freeEntries.empty()) {
+        handle = static_cast<int>(m_entries.size());
+        m_entries.push_back(Entry{});
+    } else {
+        handle = m_freeEntries.back();
+        m_freeEntries.pop_back();
+    }
+
+    m_entries[handle].bounds = Bounds{item->boundingBox()};
+    m_entries[handle].item = item;
+    m_entries[handle].cells = QRect{};
+    m_entries[handle].locations.clear();
+    m_entries[handle].visitStamp = 0;
+    m_handles[item.get()] = handle;
+
+    return handle;
+}
+
+void GridIndex::releaseEntry(int handle) {
+    m_handles.erase(m_entries[handle].item.get());
+    m_entries[handle].item.reset();
+    m_freeEntries.push_back(handle);
+}
+
+void GridIndex::pushSlot(int cell, int handle) {
+    Cell &cur{m_cells[cell]};
+    m_entries[handle].locations.push_back(Location{cell, cur.handles.size()});
+
+    if (cell == largeCell) {
+        // this cell has no place of its own, it covers whatever its items cover
+        const Bounds &bounds{m_entries[handle].bounds};
+        cur.looseBounds = cur.handles.isEmpty() ? bounds : cur.looseBounds.united(bounds);
+    }
+
+    cur.bounds.push_back(m_entries[handle].bounds);
+    cur.handles.push_back(handle);
+}
+
+void GridIndex::removeSlot(int cell, qsizetype slot) {
+    Cell &cur{m_cells[cell]};
+
+    auto &locations{m_entries[cur.handles[slot]].locations};
+    for (Location &location : locations) {
+        if (location.cell == cell && location.slot == slot) {
+            location = locations.back();
+            locations.pop_back();
+            break;
+        }
+    }
+
+    // order within a cell does not matter, so fill the gap with the last slot
+    qsizetype last{cur.handles.size() - 1};
+    if (slot != last) {
+        int moved{cur.handles[last]};
+        for (Location &location : m_entries[moved].locations) {
+            if (location.cell == cell && location.slot == last) {
+                location.slot = slot;
+                break;
+            }
+        }
+
+        cur.bounds[slot] = cur.bounds[last];
+        cur.handles[slot] = moved;
+    }
+
+    cur.bounds.pop_back();
+    cur.handles.pop_back();
+}
+
+void GridIndex::insertItem(std::shared_ptr<Item> item, bool updateOrder) {
+    if (m_handles.contains(item.get())) {
+        updateItem(item);
+        return;
+    }
+
+    insert(acquireEntry(item));
+
+    if (updateOrder)
+        m_orderedList->insert(item);
+}
+
+void GridIndex::insert(int handle) {
+    QRect cells{cellsAround(m_entries[handle].bounds)};
+    qint64 count{(static_cast<qint64>(cells.right()) - cells.left() + 1) *
+                 (static_cast<qint64>(cells.bottom()) - cells.top() + 1)};
+
+    if (count > Common::gridIndexMaxCells) {
+        m_entries[handle].cells = QRect{};
+        pushSlot(largeCell, handle);
+        return;
+    }
+
+    m_entries[handle].cells = cells;
+    for (int y{cells.top()}; y <= cells.bottom(); y++) {
+        for (int x{cells.left()}; x <= cells.right(); x++) {
+            pushSlot(cellFor(QPoint{x, y}), handle);
+        }
+    }
+}
+
+void GridIndex::deleteItem(std::shared_ptr<Item> const item, bool updateOrder) {
+    auto it{m_handles.find(item.get())};
+    if (it == m_handles.end()) {
+        return;
+    }
+
+    int handle{it->second};
+    erase(handle);
+    releaseEntry(handle);
+
+    if (updateOrder)
+        m_orderedList->remove(item);
+}
+
+void GridIndex::erase(int handle) {
+    // the back references point straight at every slot holding the handle
+    auto &locations{m_entries[handle].locations};
+    while (!locations.empty()) {
+        Location location{locations.back()};
+        removeSlot(location.cell, location.slot);
+
+        if (location.cell != largeCell && m_cells[location.cell].handles.isEmpty()) {
+            releaseCell(location.cell);
+        }
+    }
+}
+
+void GridIndex::updateItem(std::shared_ptr<Item> item) {
+    auto it{m_handles.find(item.get())};
+    if (it == m_handles.end()) {
+        return;
+    }
+
+    int handle{it->second};
+    Bounds bounds{item->boundingBox()};
+
+    // still in the same cells, only the cached boxes change
+    Entry &entry{m_entries[handle]};
+    if (!entry.cells.isNull() && cellsAround(bounds) == entry.cells) {
+        entry.bounds = bounds;
+        for (const Location &location : entry.locations) {
+            m_cells[location.cell].bounds[location.slot] = bounds;
+        }
+        return;
+    }
+
+    erase(handle);
+    entry.bounds = bounds;
+    insert(handle);
+}
+
+void GridIndex::bulkLoad(const QVector<std::shared_ptr<Item>> &items, bool updateOrder) {
+    // there is no structure to build, so this only saves growing the tables item by item
+    clear();
+    m_entries.reserve(items.size());
+    m_handles.reserve(items.size());
+
+    for (const std::shared_ptr<Item> &item : items) {
+        if (!m_handles.contains(item.get())) {
+            insert(acquireEntry(item));
+        }
+    }
+
+    if (updateOrder) {
+        m_orderedList->clear();
+        for (const std::shared_ptr<Item> &item : items) {
+            m_orderedList->insert(item);
+        }
+    }
+}
+
+void GridIndex::compact() {
+    // move the live entries to the front of the table, so the handles are dense again
+    std::vector<Entry> entries{};
+    entries.reserve(m_handles.size());
+
+    for (Entry &entry : m_entries) {
+        if (entry.item != nullptr) {
+            entry.locations.clear();
+            entries.push_back(std::move(entry));
+        }
+    }
+
+    m_entries = std::move(entries);
+    m_freeEntries = {};
+    reset();
+
+    for (int handle{0}; handle < static_cast<int>(m_entries.size()); handle++) {
+        m_handles[m_entries[handle].item.get()] = handle;
+        insert(handle);
+    }
+
+    m_cells.shrink_to_fit();
+}
+
+bool GridIndex::fragmented() const {
+    return m_freeCells.size() * 4 > m_cells.size() || m_freeEntries.size() * 4 > m_entries.size();
+}
+
+void GridIndex::search(const Bounds &area, CandidateVisitor visit) const {
+    m_queryStamp++;
+
+    const Cell &large{m_cells[largeCell]};
+    if (!large.handles.isEmpty() && large.looseBounds.overlaps(area)) {
+        scan(largeCell, area, visit);
+    }
+
+    QRect cells{cellsAround(area)};
+
+    // when the area covers more cells than there are, walking the map is cheaper
+    qint64 columns{static_cast<qint64>(cells.right()) - cells.left() + 1};
+    qint64 rows{static_cast<qint64>(cells.bottom()) - cells.top() + 1};
+
+    if (columns * rows > m_cellIndex.size()) {
+        for (auto it{m_cellIndex.cbegin()}; it != m_cellIndex.cend(); it++) {
+            if (cells.contains(it.key())) {
+                scan(it.value(), area, visit);
+            }
+        }
+        return;
+    }
+
+    for (int y{cells.top()}; y <= cells.bottom(); y++) {
+        for (int x{cells.left()}; x <= cells.right(); x++) {
+            auto it{m_cellIndex.constFind(QPoint{x, y})};
+            if (it != m_cellIndex.cend()) {
+                scan(it.value(), area, visit);
+            }
+        }
+    }
+}
+
+void GridIndex::scan(int cell, const Bounds &area, CandidateVisitor visit) const {
+    const Cell &cur{m_cells[cell]};
+    const Bounds *bounds{cur.bounds.constData()};
+    const int *handles{cur.handles.constData()};
+    const qsizetype count{cur.bounds.size()};
+
+    m_lastQuery.nodesVisited++;
+    m_lastQuery.candidatesTested += count;
+
+    for (qsizetype slot{0}; slot < count; slot++) {
+        if (!bounds[slot].overlaps(area)) {
+            continue;
+        }
+
+        // an item is in every cell it overlaps, skip it if this query has already seen it
+        const Entry &entry{m_entries[handles[slot]]};
+        if (entry.visitStamp == m_queryStamp) {
+            continue;
+        }
+        entry.visitStamp = m_queryStamp;
+
+        visit(entry.item, bounds[slot]);
+    }
+}
+
+QVector<std::shared_ptr<Item>> GridIndex::getAllItems() const {
+    QVector<std::shared_ptr<Item>> curItems{};
+    curItems.reserve(static_cast<qsizetype>(m_handles.size()));
+
+    for (const Entry &entry : m_entries) {
+        if (entry.item != nullptr) {
+            curItems.push_back(entry.item);
+        }
+    }
+
+    // in stacking order, so that saving and loading a file keeps it
+    reorder(curItems);
+    return curItems;
+}
+
+void GridIndex::clear() {
+    reset();
+
+    m_entries = {};
+    m_freeEntries = {};
+    m_handles.clear();
+}
+
+QRectF GridIndex::boundingBox() const {
+    QRectF box{};
+    for (auto it{m_cellIndex.cbegin()}; it != m_cellIndex.cend(); it++) {
+        box |= QRectF{it.key().x() * m_cellSize, it.key().y() * m_cellSize, m_cellSize, m_cellSize};
+    }
+
+    if (!m_cells[largeCell].handles.isEmpty()) {
+        box |= m_cells[largeCell].looseBounds.toRect();
+    }
+
+    return box;
+}
+
+QString GridIndex::name() const {
+    return "GridIndex";
+}
+
+int GridIndex::size() const {
+    return static_cast<int>(m_handles.size());
+}
+
+void GridIndex::draw(QPainter &painter, const QPointF &offset) const {
+    painter.save();
+
+    QPen pen{Qt::green};
+    painter.setPen(pen);
+    for (auto it{m_cellIndex.cbegin()}; it != m_cellIndex.cend(); it++) {
+        QRectF cell{it.key().x() * m_cellSize, it.key().y() * m_cellSize, m_cellSize, m_cellSize};
+        painter.drawRect(cell.translated(-offset));
+    }
+
+    painter.restore();
+}
+
+SpatialIndex::Stats GridIndex::stats() const {
+    Stats stats{size()};
+
+    // the cells are all leaves of a tree which is one level deep
+    auto addCell = [&](const Cell &cell) {
+        stats.nodes++;
+        stats.references += cell.handles.size();
+        addLeaf(stats, cell.handles.size(), 0);
+    };
+
+    if (!m_cells[largeCell].handles.isEmpty()) {
+        addCell(m_cells[largeCell]);
+    }
+
+    for (int cell : m_cellIndex) {
+        addCell(m_cells[cell]);
+    }
+
+    return stats;
+}
@@ -0,0 +1,127 @@
+/*
+ * Drawy - A simple brainstorming tool with an infinite canvas
+ * Copyright (C) 2025 - Prayag Jain <prayagjain2@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QHash>
+#include <QPainter>
+#include <QPoint>
+#include <QRect>
+#include <QRectF>
+#include <QVarLengthArray>
+#include <QVector>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "../item/item.hpp"
+#include "bounds.hpp"
+#include "spatialindex.hpp"
+
+class OrderedList;
+
+/*
+ * A uniform grid of square cells, of which only the ones holding items exist, looked up
+ * in a hash map. Every item is put in all the cells it overlaps, so there is no tree to
+ * walk and moving an item within its cells only rewrites its cached box. This suits
+ * boards with lots of small items of similar size, like handwriting.
+ *
+ * Items covering too many cells are kept in a separate list instead of being copied
+ * into all of them.
+ */
+class GridIndex : public SpatialIndex {
+private:
+    // where a handle is stored, lets an entry be removed without searching the cells
+    struct Location {
+        int cell{};
+        qsizetype slot{};
+    };
+
+    struct Entry {
+        ItemPtr item{};
+        Bounds bounds{};
+        QRect cells{};  // the cells the item is in, empty for the large items
+        QVarLengthArray<Location, 4> locations{};
+        mutable quint64 visitStamp{};  // stamp of the last query which saw this entry
+    };
+
+    struct Cell {
+        QPoint key{};
+        Bounds looseBounds{};  // only kept for the list of large items
+        QVector<Bounds> bounds{};
+        QVector<int> handles{};
+    };
+
+    // holds the items covering too many cells
+    static constexpr int largeCell{0};
+
+    std::vector<Cell> m_cells{};
+    std::vector<int> m_freeCells{};
+    QHash<QPoint, int> m_cellIndex{};  // cell coordinates to cell
+    std::vector<Entry> m_entries{};
+    std::vector<int> m_freeEntries{};
+    std::unordered_map<Item *, int> m_handles{};
+    qreal m_cellSize{};
+
+    // every query gets a new stamp, which is how items present in multiple cells
+    // are reported only once without keeping a set of the ones already seen
+    mutable quint64 m_queryStamp{};
+
+public:
+    GridIndex(qreal cellSize);
+    GridIndex(qreal cellSize, std::shared_ptr<OrderedList> orderedList);
+
+    ~GridIndex();
+
+    QString name() const override;
+    int size() const override;
+    void insertItem(ItemPtr item, bool updateOrder = true) override;
+    void deleteItem(ItemPtr item, bool updateOrder = true) override;
+    void updateItem(ItemPtr item) override;
+    void bulkLoad(const QVector<ItemPtr> &items, bool updateOrder = true) override;
+
+    void compact() override;
+    bool fragmented() const override;
+
+    QVector<ItemPtr> getAllItems() const override;
+    void clear() override;
+
+    void draw(QPainter &painter, const QPointF &offset) const override;
+    QRectF boundingBox() const override;
+    Stats stats() const override;
+
+protected:
+    void search(const Bounds &area, CandidateVisitor visit) const override;
+
+private:
+    void insert(int handle);
+    void erase(int handle);
+    void reset();
+
+    QPoint cellAt(const QPointF &point) const;
+    QRect cellsAround(const Bounds &bounds) const;
+    int cellFor(const QPoint &key);
+    void releaseCell(int cell);
+    void scan(int cell, const Bounds &area, CandidateVisitor visit) const;
+
+    void pushSlot(int cell, int handle);
+    void removeSlot(int cell, qsizetype slot);
+
+    int acquireEntry(ItemPtr item);
+    void releaseEntry(int handle);
+};
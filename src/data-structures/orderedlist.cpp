@@ -19,20 +19,36 @@
 #include "orderedlist.hpp"
 
 #include <QDebug>
+#include <algorithm>
 #include <stdexcept>
 
+#include "../common/constants.hpp"
+#include "../item/item.hpp"
+
 OrderedList::~OrderedList() {
+    // the items may outlive the list and go into another one
+    clear();
     qDebug() << "Object deleted: OrderedList";
 }
 
 bool OrderedList::hasItem(ItemPtr item) const {
-    if (m_itemIterMap.find(item) == m_itemIterMap.end()) {
-        return false;
+    return m_itemIterMap.find(item) != m_itemIterMap.end();
+}
+
+OrderedList::Iterator OrderedList::find(const ItemPtr &item) {
+    auto it{m_itemIterMap.find(item)};
+    if (it == m_itemIterMap.end()) {
+        throw std::runtime_error("Item was not found in the iterator map");
     }
-    if (m_zIndex.find(item) == m_zIndex.end()) {
-        return false;
+    return it->second;
+}
+
+void OrderedList::adopt(const ItemPtr &item) {
+    // a second list would overwrite the indices this one gave out
+    if (item->m_orderedList != nullptr && item->m_orderedList != this) {
+        throw std::logic_error("Item is already in another ordered list");
     }
-    return true;
+    item->m_orderedList = this;
 }
 
 void OrderedList::insert(ItemPtr item) {
@@ -41,35 +57,71 @@ void OrderedList::insert(ItemPtr item) {
         return;
     }
 
-    int zIndex{0};
-    if (!m_itemList.empty()) {
-        zIndex = m_zIndex[m_itemList.back()] + 1;
-    }
-
-    qDebug() << "Inserting item with index: " << zIndex;
-    m_zIndex[item] = zIndex;
+    adopt(item);
     m_itemList.push_back(item);
     m_itemIterMap[item] = std::prev(m_itemList.end());
+    label(std::prev(m_itemList.end()), m_itemList.end(), 1);
+
+    qDebug() << "Inserting item with index: " << item->m_zIndex;
 }
 
 void OrderedList::remove(ItemPtr item) {
+    auto it{m_itemIterMap.find(item)};
+
     // item already deleted
-    if (!hasItem(item)) {
+    if (it == m_itemIterMap.end()) {
         return;
     }
 
     qDebug() << "Erasing item from list";
-    m_itemList.erase(m_itemIterMap[item]);
-    m_itemIterMap.erase(item);
-    m_zIndex.erase(item);
+    item->m_orderedList = nullptr;
+    m_itemList.erase(it->second);
+    m_itemIterMap.erase(it);
 }
 
-void OrderedList::bringForward(ItemPtr item) {
-    if (!hasItem(item)) {
-        throw std::runtime_error("Item was not found in the iterator map");
+void OrderedList::clear() {
+    for (const ItemPtr &item : m_itemList) {
+        item->m_orderedList = nullptr;
+    }
+
+    m_itemList.clear();
+    m_itemIterMap.clear();
+}
+
+void OrderedList::insertBlock(const QVector<ItemPtr> &items, ItemPtr below) {
+    if (items.empty()) {
+        return;
     }
 
-    auto iterator = m_itemIterMap[item];
+    // take out the items which are already in the list first, one of them could be
+    // sitting right where the block is going
+    for (const ItemPtr &item : items) {
+        if (item != below) {
+            remove(item);
+        }
+    }
+
+    Iterator position{m_itemList.end()};
+    if (below != nullptr && hasItem(below)) {
+        position = std::next(m_itemIterMap[below]);
+    }
+
+    Iterator first{position};
+    for (qsizetype i{items.size() - 1}; i >= 0; --i) {
+        if (items[i] == below) {
+            continue;
+        }
+
+        adopt(items[i]);
+        first = m_itemList.insert(first, items[i]);
+        m_itemIterMap[items[i]] = first;
+    }
+
+    label(first, position, std::distance(first, position));
+}
+
+void OrderedList::bringForward(ItemPtr item) {
+    auto iterator{find(item)};
 
     // if this is the last element, no need to bring it to the front
     if (iterator == std::prev(m_itemList.end())) {
@@ -80,17 +132,11 @@ void OrderedList::bringForward(ItemPtr item) {
     auto nextIterator = std::next(iterator);
     m_itemList.splice(iterator, m_itemList, nextIterator);
 
-    int val = m_zIndex[item];
-    m_zIndex[item] = m_zIndex[*nextIterator];
-    m_zIndex[*nextIterator] = val;
+    std::swap(item->m_zIndex, (*nextIterator)->m_zIndex);
 }
 
 void OrderedList::sendBackward(ItemPtr item) {
-    if (!hasItem(item)) {
-        throw std::runtime_error("Item was not found in the iterator map");
-    }
-
-    auto iterator = m_itemIterMap[item];
+    auto iterator{find(item)};
 
     // if this is the first element, no need to send it to the back
     if (iterator == m_itemList.begin()) {
@@ -101,44 +147,169 @@ void OrderedList::sendBackward(ItemPtr item) {
     auto prevIterator = std::prev(iterator);
     m_itemList.splice(prevIterator, m_itemList, iterator);
 
-    int val = m_zIndex[item];
-    m_zIndex[item] = m_zIndex[*prevIterator];
-    m_zIndex[*prevIterator] = val;
+    std::swap(item->m_zIndex, (*prevIterator)->m_zIndex);
 };
 
 void OrderedList::sendToBack(ItemPtr item) {
-    if (!hasItem(item)) {
-        throw std::runtime_error("Item was not found in the iterator map");
-    }
-
-    auto iterator = m_itemIterMap[item];
+    auto iterator{find(item)};
     if (iterator == m_itemList.begin()) {
         return;
     }
 
-    auto firstIterator = m_itemList.begin();
-    m_itemList.splice(firstIterator, m_itemList, iterator);
-    m_zIndex[item] = m_zIndex[*firstIterator] - 1;
+    move(iterator, m_itemList.begin());
 }
 
 void OrderedList::bringToFront(ItemPtr item) {
-    if (!hasItem(item)) {
-        throw std::runtime_error("Item was not found in the iterator map");
+    auto iterator{find(item)};
+    if (iterator == std::prev(m_itemList.end())) {
+        return;
     }
 
-    auto iterator = m_itemIterMap[item];
-    if (iterator == std::prev(m_itemList.end())) {
+    move(iterator, m_itemList.end());
+}
+
+void OrderedList::bringForward(const QVector<ItemPtr> &items) {
+    // the topmost item goes first, so that the ones below it can follow it up, and items
+    // which are already stacked on top of everything stay where they are
+    const QVector<Iterator> iterators{sorted(items, true)};
+
+    Iterator blocked{m_itemList.end()};
+    for (Iterator iterator : iterators) {
+        auto nextIterator{std::next(iterator)};
+        if (nextIterator == blocked) {
+            blocked = iterator;
+            continue;
+        }
+
+        m_itemList.splice(iterator, m_itemList, nextIterator);
+        std::swap((*iterator)->m_zIndex, (*nextIterator)->m_zIndex);
+    }
+}
+
+void OrderedList::sendBackward(const QVector<ItemPtr> &items) {
+    const QVector<Iterator> iterators{sorted(items, false)};
+
+    Iterator blocked{m_itemList.end()};
+    for (Iterator iterator : iterators) {
+        if (iterator == m_itemList.begin() || std::prev(iterator) == blocked) {
+            blocked = iterator;
+            continue;
+        }
+
+        auto prevIterator{std::prev(iterator)};
+        m_itemList.splice(prevIterator, m_itemList, iterator);
+        std::swap((*iterator)->m_zIndex, (*prevIterator)->m_zIndex);
+    }
+}
+
+void OrderedList::sendToBack(const QVector<ItemPtr> &items) {
+    if (items.empty()) {
+        return;
+    }
+
+    // moving the topmost item first keeps the selection in the same order at the bottom
+    const QVector<Iterator> iterators{sorted(items, true)};
+    for (Iterator iterator : iterators) {
+        m_itemList.splice(m_itemList.begin(), m_itemList, iterator);
+    }
+
+    label(m_itemList.begin(), std::next(iterators.front()), iterators.size());
+}
+
+void OrderedList::bringToFront(const QVector<ItemPtr> &items) {
+    if (items.empty()) {
         return;
     }
 
-    auto lastIterator = std::prev(m_itemList.end());
-    m_itemList.splice(m_itemList.end(), m_itemList, iterator);
-    m_zIndex[item] = m_zIndex[*lastIterator] + 1;
+    const QVector<Iterator> iterators{sorted(items, false)};
+    for (Iterator iterator : iterators) {
+        m_itemList.splice(m_itemList.end(), m_itemList, iterator);
+    }
+
+    label(iterators.front(), m_itemList.end(), iterators.size());
 }
 
-int OrderedList::zIndex(ItemPtr item) const {
+qint64 OrderedList::zIndex(ItemPtr item) const {
     if (!hasItem(item)) {
         throw std::runtime_error("Item not found in zIndex map");
     }
-    return m_zIndex.at(item);
+    return item->m_zIndex;
+}
+
+QVector<OrderedList::Iterator> OrderedList::sorted(const QVector<ItemPtr> &items,
+                                                   bool descending) {
+    QVector<Iterator> iterators{};
+    iterators.reserve(items.size());
+
+    for (const ItemPtr &item : items) {
+        iterators.push_back(find(item));
+    }
+
+    std::sort(iterators.begin(), iterators.end(), [descending](Iterator first, Iterator second) {
+        if (descending) {
+            std::swap(first, second);
+        }
+        return (*first)->m_zIndex < (*second)->m_zIndex;
+    });
+
+    return iterators;
+}
+
+void OrderedList::move(Iterator iterator, Iterator position) {
+    m_itemList.splice(position, m_itemList, iterator);
+    label(iterator, std::next(iterator), 1);
+}
+
+void OrderedList::label(Iterator first, Iterator last, qint64 count) {
+    // Gives the `count` items in [first, last) evenly spaced indices between those of
+    // their neighbours. When there is no room left, the window is widened on both sides
+    // until it covers enough of the index space; the wider the window, the more room is
+    // asked for, so that a renumbered region doesn't need renumbering again soon.
+    qint64 slack{1};
+
+    while (true) {
+        const bool bottom{first == m_itemList.begin()};
+        const bool top{last == m_itemList.end()};
+        const qint64 low{bottom ? minZIndex : (*std::prev(first))->m_zIndex};
+        const qint64 high{top ? maxZIndex : (*last)->m_zIndex};
+
+        // the open ends of the list only use the regular spacing, which leaves room
+        // for the items that will be put there later
+        qint64 step{(high - low) / (count + 1)};
+        if (bottom || top) {
+            step = std::min(step, Common::zIndexGap);
+        }
+
+        // with the whole list in the window, any room at all will do
+        if (step >= (bottom && top ? 1 : slack)) {
+            qint64 zIndex{low + step};
+            if (bottom && top) {
+                zIndex = -step * (count / 2);
+            } else if (bottom) {
+                zIndex = high - step * count;
+            }
+
+            for (Iterator iterator{first}; iterator != last; ++iterator) {
+                (*iterator)->m_zIndex = zIndex;
+                zIndex += step;
+            }
+            return;
+        }
+
+        if (bottom && top) {
+            throw std::runtime_error("Ran out of z-indices");
+        }
+
+        const qint64 grow{std::max<qint64>(count, 1)};
+        for (qint64 i{0}; i < grow && first != m_itemList.begin(); ++i) {
+            --first;
+            ++count;
+        }
+        for (qint64 i{0}; i < grow && last != m_itemList.end(); ++i) {
+            ++last;
+            ++count;
+        }
+
+        slack = count;
+    }
 }
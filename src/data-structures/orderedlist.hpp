@@ -18,32 +18,65 @@
 
 #pragma once
 
+#include <QVector>
+#include <QtGlobal>
 #include <list>
 #include <memory>
 #include <unordered_map>
 class Item;
 
 // Keeps track of the z-index of every item
+// The z-index itself is stored on the item (see Item::zIndex), so that comparing two
+// items is a plain integer comparison instead of a couple of hash map lookups.
+// The indices are spaced apart, so an item can be placed between two others by picking
+// a number in between; only when two neighbours run out of room is a small window
+// around them renumbered, which keeps moving items around cheap even on large boards.
+// As the index lives on the item, an item can only be in one list at a time, indexes
+// over the same items have to share their list.
 class OrderedList {
 public:
     using ItemPtr = std::shared_ptr<Item>;
 
 private:
-    std::unordered_map<ItemPtr, std::list<ItemPtr>::iterator> m_itemIterMap;
+    using Iterator = std::list<ItemPtr>::iterator;
+
+    static constexpr qint64 minZIndex{-(qint64{1} << 62)};
+    static constexpr qint64 maxZIndex{(qint64{1} << 62) - 1};
+
+    std::unordered_map<ItemPtr, Iterator> m_itemIterMap;
     std::list<ItemPtr> m_itemList;
-    std::unordered_map<ItemPtr, int> m_zIndex;
 
 public:
     ~OrderedList();
 
     void insert(ItemPtr item);
     void remove(ItemPtr item);
+    void clear();
+
+    // places the items, in the given order, right above `below` (or on top of everything
+    // if it is null or not in the list); items already in the list are moved there
+    void insertBlock(const QVector<ItemPtr> &items, ItemPtr below);
 
     void bringForward(ItemPtr item);
     void sendBackward(ItemPtr item);
     void sendToBack(ItemPtr item);
     void bringToFront(ItemPtr item);
+
+    // the same as above, for a whole selection at once; the items keep their order
+    // relative to each other
+    void bringForward(const QVector<ItemPtr> &items);
+    void sendBackward(const QVector<ItemPtr> &items);
+    void sendToBack(const QVector<ItemPtr> &items);
+    void bringToFront(const QVector<ItemPtr> &items);
+
     bool hasItem(ItemPtr item) const;
 
-    int zIndex(ItemPtr item) const;
+    qint64 zIndex(ItemPtr item) const;
+
+private:
+    Iterator find(const ItemPtr &item);
+    void adopt(const ItemPtr &item);
+    QVector<Iterator> sorted(const QVector<ItemPtr> &items, bool descending);
+    void move(Iterator iterator, Iterator position);
+    void label(Iterator first, Iterator last, qint64 count);
 };
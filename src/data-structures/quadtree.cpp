@@ -19,209 +19,886 @@
 #include "quadtree.hpp"
 
 #include <QDebug>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
 #include <cstdlib>
 #include <memory>
 
+#include "../common/constants.hpp"
 #include "../item/item.hpp"
 #include "orderedlist.hpp"
 
-QuadTree::QuadTree(QRectF region, int capacity) : m_boundingBox{region}, m_capacity{capacity} {
-    if (m_orderedList == nullptr) {
-        m_orderedList = std::make_shared<OrderedList>();
-    }
+QuadTree::QuadTree(int capacity, Mode mode)
+    : QuadTree{capacity, std::make_shared<OrderedList>(), mode} {
 }
 
-QuadTree::QuadTree(QRectF region, int capacity, std::shared_ptr<OrderedList> orderedList)
-    : m_boundingBox{region},
-      m_capacity{capacity} {
-    m_orderedList = orderedList;
+QuadTree::QuadTree(int capacity,
+                   std::shared_ptr<OrderedList> orderedList,
+                   Mode mode,
+                   qreal minNodeSize)
+    : SpatialIndex{orderedList},
+      m_capacity{capacity},
+      m_minNodeSize{minNodeSize},
+      m_mode{mode} {
+    m_nodes.push_back(makeNode(QRectF{}, -1));
 }
 
 QuadTree::~QuadTree() {
     qDebug() << "Object deleted: QuadTree";
 }
 
-void QuadTree::subdivide() {
-    double x{m_boundingBox.x()};
-    double y{m_boundingBox.y()};
-    double halfWidth{m_boundingBox.width() / 2};
-    double halfHeight{m_boundingBox.height() / 2};
+QuadTree::Node QuadTree::makeNode(const QRectF &box, int parent) const {
+    Node node{box};
+    node.parent = parent;
+    node.looseBounds = looseBoundsOf(box);
+    node.splitAt = m_capacity;
+
+    return node;
+}
+
+Bounds QuadTree::looseBoundsOf(const QRectF &box) const {
+    if (m_mode == Mode::Split) {
+        return Bounds{box};
+    }
+
+    double halfWidth{box.width() / 2};
+    double halfHeight{box.height() / 2};
+    return Bounds{box.adjusted(-halfWidth, -halfHeight, halfWidth, halfHeight)};
+}
+
+std::array<QRectF, 4> QuadTree::quadrants(const QRectF &box) {
+    // top left, top right, bottom right, bottom left
+    double x{box.x()};
+    double y{box.y()};
+    double halfWidth{box.width() / 2};
+    double halfHeight{box.height() / 2};
+
+    return {QRectF{x, y, halfWidth, halfHeight},
+            QRectF{x + halfWidth, y, halfWidth, halfHeight},
+            QRectF{x + halfWidth, y + halfHeight, halfWidth, halfHeight},
+            QRectF{x, y + halfHeight, halfWidth, halfHeight}};
+}
 
-    QRectF topLeftRect{x, y, halfWidth, halfHeight};
-    QRectF topRightRect{x + halfWidth, y, halfWidth, halfHeight};
-    QRectF bottomRightRect{x + halfWidth, y + halfHeight, halfWidth, halfHeight};
-    QRectF bottomLeftRect{x, y + halfHeight, halfWidth, halfHeight};
+int QuadTree::quadrantOf(const QRectF &box, const Bounds &bounds) {
+    // the quadrant holding the center of the bounds
+    static constexpr int quadrant[2][2]{{0, 1}, {3, 2}};
+
+    QPointF center{box.center()};
+    bool right{(bounds.left + bounds.right) / 2 >= center.x()};
+    bool bottom{(bounds.top + bounds.bottom) / 2 >= center.y()};
+
+    return quadrant[bottom][right];
+}
+
+void QuadTree::subdivide(int node) {
+    std::array<QRectF, 4> boxes{quadrants(m_nodes[node].box)};
+
+    int firstChild{};
+    if (m_freeBlocks.empty()) {
+        // this may reallocate the pool, so no references to nodes are held across it
+        firstChild = static_cast<int>(m_nodes.size());
+        for (const QRectF &childBox : boxes) {
+            m_nodes.push_back(makeNode(childBox, node));
+        }
+    } else {
+        firstChild = m_freeBlocks.back();
+        m_freeBlocks.pop_back();
+        for (int child{0}; child < 4; child++) {
+            m_nodes[firstChild + child] = makeNode(boxes[child], node);
+        }
+    }
 
-    m_topLeft = std::make_unique<QuadTree>(topLeftRect, m_capacity, m_orderedList);
-    m_topRight = std::make_unique<QuadTree>(topRightRect, m_capacity, m_orderedList);
-    m_bottomRight = std::make_unique<QuadTree>(bottomRightRect, m_capacity, m_orderedList);
-    m_bottomLeft = std::make_unique<QuadTree>(bottomLeftRect, m_capacity, m_orderedList);
+    m_nodes[node].firstChild = firstChild;
+}
+
+bool QuadTree::attached(int node) const {
+    // false for nodes which have been released by a collapse
+    int parent{m_nodes[node].parent};
+    if (parent == -1) {
+        if (node == oversizedNode) {
+            return true;
+        }
+
+        int level{levelOf(node)};
+        auto it{m_tiles[level].constFind(tileAt(m_nodes[node].box.center(), level))};
+        return it != m_tiles[level].cend() && it.value() == node;
+    }
+
+    int firstChild{m_nodes[parent].firstChild};
+    return firstChild != -1 && node >= firstChild && node < firstChild + 4;
+}
+
+void QuadTree::collapse(int node) {
+    // Merges groups of leaves back into their parent once they hold few enough items,
+    // going up as long as possible, and drops tiles which became empty. Only half the
+    // capacity is allowed, so that a node does not split and merge over and over when
+    // items come and go around the limit.
+    if (!attached(node)) {
+        return;
+    }
+
+    // a leaf which was too full of large items to be split gets another chance
+    if (m_nodes[node].handles.size() < m_capacity) {
+        m_nodes[node].splitAt = m_capacity;
+    }
+
+    if (m_nodes[node].firstChild == -1 && m_nodes[node].parent != -1) {
+        node = m_nodes[node].parent;
+    }
+
+    while (true) {
+        int firstChild{m_nodes[node].firstChild};
+        if (firstChild != -1) {
+            qsizetype total{m_nodes[node].handles.size()};
+
+            for (int child{firstChild}; child < firstChild + 4; child++) {
+                if (m_nodes[child].firstChild != -1) {
+                    return;
+                }
+                total += m_nodes[child].handles.size();
+            }
+
+            if (total > m_capacity / 2) {
+                return;
+            }
+
+            for (int child{firstChild}; child < firstChild + 4; child++) {
+                while (!m_nodes[child].handles.isEmpty()) {
+                    int handle{m_nodes[child].handles.back()};
+                    removeSlot(child, m_nodes[child].handles.size() - 1);
+
+                    // in split mode the item may be in several of the children
+                    bool present{false};
+                    for (const Location &location : m_entries[handle].locations) {
+                        present = present || location.node == node;
+                    }
+
+                    if (!present) {
+                        pushSlot(node, handle);
+                    }
+                }
+
+                m_nodes[child] = Node{};
+            }
+
+            m_nodes[node].firstChild = -1;
+            m_freeBlocks.push_back(firstChild);
+        }
+
+        int parent{m_nodes[node].parent};
+        if (parent == -1) {
+            if (node != oversizedNode && m_nodes[node].handles.isEmpty()) {
+                releaseTile(node);
+            }
+            return;
+        }
+
+        node = parent;
+    }
+}
+
+qreal QuadTree::tileSize(int level) {
+    qreal size{Common::quadTreeTileSize};
+    for (int coarser{0}; coarser < level; coarser++) {
+        size *= Common::quadTreeLevelFactor;
+    }
+    return size;
+}
+
+QPoint QuadTree::tileAt(const QPointF &point, int level) const {
+    // clamped, so that absurdly far away points do not overflow, anything out there
+    // does not fit its tile and ends up with the oversized items
+    constexpr qreal limit{1 << 29};
+
+    qreal size{tileSize(level)};
+    qreal x{std::clamp(std::floor(point.x() / size), -limit, limit)};
+    qreal y{std::clamp(std::floor(point.y() / size), -limit, limit)};
+
+    return QPoint{static_cast<int>(x), static_cast<int>(y)};
+}
+
+QRect QuadTree::tilesAround(const Bounds &bounds, qreal margin, int level) const {
+    return QRect{tileAt(QPointF{bounds.left - margin, bounds.top - margin}, level),
+                 tileAt(QPointF{bounds.right + margin, bounds.bottom + margin}, level)};
+}
+
+int QuadTree::tileRoot(const QPoint &tile, int level) {
+    auto it{m_tiles[level].constFind(tile)};
+    if (it != m_tiles[level].cend()) {
+        return it.value();
+    }
+
+    qreal size{tileSize(level)};
+    QRectF box{tile.x() * size, tile.y() * size, size, size};
+
+    int root{};
+    if (m_freeRoots.empty()) {
+        root = static_cast<int>(m_nodes.size());
+        m_nodes.push_back(makeNode(box, -1));
+    } else {
+        root = m_freeRoots.back();
+        m_freeRoots.pop_back();
+        m_nodes[root] = makeNode(box, -1);
+    }
+
+    m_tiles[level].insert(tile, root);
+    return root;
+}
+
+void QuadTree::releaseTile(int root) {
+    int level{levelOf(root)};
+    m_tiles[level].remove(tileAt(m_nodes[root].box.center(), level));
+    m_nodes[root] = Node{};
+    m_freeRoots.push_back(root);
+}
+
+int QuadTree::levelOf(int root) const {
+    // the roots of a level all have the tile size of that level
+    int level{0};
+    while (level + 1 < Common::quadTreeTileLevels && m_nodes[root].box.width() > tileSize(level)) {
+        level++;
+    }
+    return level;
+}
+
+int QuadTree::levelFor(const Bounds &bounds) const {
+    // the finest tile level the item fits in, -1 if it is too large for all of them
+    for (int level{0}; level < Common::quadTreeTileLevels; level++) {
+        if (fitsTile(bounds, level)) {
+            return level;
+        }
+    }
+    return -1;
+}
+
+bool QuadTree::fitsTile(const Bounds &bounds, int level) const {
+    qreal size{tileSize(level)};
+    if (m_mode == Mode::Split) {
+        // at most four tiles get a copy of the item
+        return bounds.right - bounds.left <= size && bounds.bottom - bounds.top <= size;
+    }
+
+    QPointF center{(bounds.left + bounds.right) / 2, (bounds.top + bounds.bottom) / 2};
+    QPoint tile{tileAt(center, level)};
+
+    Bounds tileBounds{
+        tile.x() * size, tile.y() * size, (tile.x() + 1) * size, (tile.y() + 1) * size};
+    return tileBounds.adjusted(size / 2).contains(bounds);
+}
+
+int QuadTree::acquireEntry(std::shared_ptr<Item> item) {
+    int handle{};
+    if (m_freeEntries.empty()) {
+        handle = static_cast<int>(m_entries.size());
+        m_entries.push_back(Entry{});
+    } else {
+        handle = m_freeEntries.back();
+        m_freeEntries.pop_back();
+    }
+
+    m_entries[handle].bounds = Bounds{item->boundingBox()};
+    m_entries[handle].item = item;
+    m_entries[handle].locations.clear();
+    m_entries[handle].visitStamp = 0;
+    m_handles[item.get()] = handle;
+
+    return handle;
+}
+
+void QuadTree::releaseEntry(int handle) {
+    m_handles.erase(m_entries[handle].item.get());
+    m_entries[handle].item.reset();
+    m_freeEntries.push_back(handle);
+}
+
+void QuadTree::pushSlot(int node, int handle) {
+    Node &cur{m_nodes[node]};
+    m_entries[handle].locations.push_back(Location{node, cur.handles.size()});
+
+    if (node == oversizedNode) {
+        // this node has no box of its own, it covers whatever its items cover
+        const Bounds &bounds{m_entries[handle].bounds};
+        if (cur.handles.isEmpty()) {
+            cur.looseBounds = bounds;
+        } else {
+            cur.looseBounds.left = std::min(cur.looseBounds.left, bounds.left);
+            cur.looseBounds.top = std::min(cur.looseBounds.top, bounds.top);
+            cur.looseBounds.right = std::max(cur.looseBounds.right, bounds.right);
+            cur.looseBounds.bottom = std::max(cur.looseBounds.bottom, bounds.bottom);
+        }
+    }
+
+    cur.bounds.push_back(m_entries[handle].bounds);
+    cur.handles.push_back(handle);
+}
+
+void QuadTree::removeSlot(int node, qsizetype slot) {
+    Node &cur{m_nodes[node]};
+
+    auto &locations{m_entries[cur.handles[slot]].locations};
+    for (Location &location : locations) {
+        if (location.node == node && location.slot == slot) {
+            location = locations.back();
+            locations.pop_back();
+            break;
+        }
+    }
+
+    // order within a node does not matter, so fill the gap with the last slot
+    qsizetype last{cur.handles.size() - 1};
+    if (slot != last) {
+        int moved{cur.handles[last]};
+        for (Location &location : m_entries[moved].locations) {
+            if (location.node == node && location.slot == last) {
+                location.slot = slot;
+                break;
+            }
+        }
+
+        cur.bounds[slot] = cur.bounds[last];
+        cur.handles[slot] = moved;
+    }
+
+    cur.bounds.pop_back();
+    cur.handles.pop_back();
+
+    if (node == oversizedNode && !cur.handles.isEmpty()) {
+        // shrink the area back to the items which are left, only the very largest items
+        // end up here, so there are never many of them
+        cur.looseBounds = cur.bounds.front();
+        for (const Bounds &bounds : cur.bounds) {
+            cur.looseBounds.left = std::min(cur.looseBounds.left, bounds.left);
+            cur.looseBounds.top = std::min(cur.looseBounds.top, bounds.top);
+            cur.looseBounds.right = std::max(cur.looseBounds.right, bounds.right);
+            cur.looseBounds.bottom = std::max(cur.looseBounds.bottom, bounds.bottom);
+        }
+    }
 }
 
 void QuadTree::insertItem(std::shared_ptr<Item> item, bool updateOrder) {
-    expand(item->boundingBox().topLeft());
-    expand(item->boundingBox().topRight());
-    expand(item->boundingBox().bottomRight());
-    expand(item->boundingBox().bottomLeft());
-    insert(item, updateOrder);
+    if (m_handles.contains(item.get())) {
+        updateItem(item);
+        return;
+    }
+
+    insert(acquireEntry(item));
+
+    if (updateOrder)
+        m_orderedList->insert(item);
+}
+
+void QuadTree::insert(int handle) {
+    const Bounds &bounds{m_entries[handle].bounds};
+    int level{levelFor(bounds)};
+    if (level == -1) {
+        pushSlot(oversizedNode, handle);
+        return;
+    }
+
+    if (m_mode == Mode::Loose) {
+        QPointF center{(bounds.left + bounds.right) / 2, (bounds.top + bounds.bottom) / 2};
+        pushSlot(homeNode(tileRoot(tileAt(center, level), level), bounds), handle);
+        return;
+    }
+
+    QRect tiles{tilesAround(bounds, 0, level)};
+    bool inserted{false};
+
+    for (int y{tiles.top()}; y <= tiles.bottom(); y++) {
+        for (int x{tiles.left()}; x <= tiles.right(); x++) {
+            int root{tileRoot(QPoint{x, y}, level)};
+            if (insertSplit(root, handle)) {
+                inserted = true;
+            } else if (m_nodes[root].handles.isEmpty() && m_nodes[root].firstChild == -1) {
+                // only touches the edge of this tile
+                releaseTile(root);
+            }
+        }
+    }
+
+    // e.g. empty items, which do not intersect anything
+    if (!inserted) {
+        pushSlot(oversizedNode, handle);
+    }
 }
 
-bool QuadTree::insert(std::shared_ptr<Item> item, bool updateOrder) {
-    if (!m_boundingBox.intersects(item->boundingBox())) {
+bool QuadTree::insertSplit(int node, int handle) {
+    const Bounds &bounds{m_entries[handle].bounds};
+    if (!bounds.intersects(m_nodes[node].box)) {
         return false;
     }
 
-    if (m_items.size() < m_capacity) {
-        m_items.push_back(item);
-        
-        if (updateOrder)
-            m_orderedList->insert(item);
+    if (m_nodes[node].firstChild == -1) {
+        if (!splittable(node)) {
+            pushSlot(node, handle);
+            return true;
+        }
 
-        return true;
+        subdivide(node);
+        distribute(node);
     }
 
-    // subdivide if not already subdivided
-    if (m_topLeft == nullptr)
-        subdivide();
+    // items larger than the children stay here
+    if (childrenFor(m_nodes[node].box, bounds) == 0) {
+        pushSlot(node, handle);
+        return true;
+    }
 
+    int firstChild{m_nodes[node].firstChild};
     bool inserted = false;
-    if (m_topLeft->insert(item, updateOrder))
-        inserted = true;
-    if (m_topRight->insert(item, updateOrder))
-        inserted = true;
-    if (m_bottomRight->insert(item, updateOrder))
-        inserted = true;
-    if (m_bottomLeft->insert(item, updateOrder))
-        inserted = true;
+    for (int child{firstChild}; child < firstChild + 4; child++) {
+        if (insertSplit(child, handle))
+            inserted = true;
+    }
+
+    if (!inserted) {
+        pushSlot(node, handle);
+    }
 
-    return inserted;
+    return true;
 }
 
-void QuadTree::deleteItem(std::shared_ptr<Item> const item, bool updateOrder) {
-    if (!m_boundingBox.intersects(item->boundingBox())) {
-        return;
+int QuadTree::childFor(int node, const Bounds &bounds) const {
+    return m_nodes[node].firstChild + quadrantOf(m_nodes[node].box, bounds);
+}
+
+int QuadTree::childrenFor(const QRectF &box, const Bounds &bounds) const {
+    // A bit for every child of a node with this box which would get the item, none if
+    // it stays in the node. Works out the children without creating them, so it can be
+    // used to decide whether the node should be split at all.
+    std::array<QRectF, 4> children{quadrants(box)};
+
+    if (m_mode == Mode::Loose) {
+        int quadrant{quadrantOf(box, bounds)};
+        return looseBoundsOf(children[quadrant]).contains(bounds) ? 1 << quadrant : 0;
+    }
+
+    // larger than a child, it would end up in most of them
+    if (bounds.right - bounds.left > box.width() / 2 ||
+        bounds.bottom - bounds.top > box.height() / 2) {
+        return 0;
     }
 
-    auto it = std::find(m_items.begin(), m_items.end(), item);
-    if (it != m_items.end()) {
-        m_items.erase(it);
+    int mask{0};
+    for (int quadrant{0}; quadrant < 4; quadrant++) {
+        if (bounds.intersects(children[quadrant])) {
+            mask |= 1 << quadrant;
+        }
+    }
+    return mask;
+}
 
-        if (updateOrder)
-            m_orderedList->remove(item);
+bool QuadTree::worthSplitting(const QRectF &box, const int *begin, const int *end) const {
+    // A query in one of the children looks at the items staying in the node and about
+    // a quarter of the ones pushed down, which has to be at most half of what it looks
+    // at now. Otherwise most of the items are too large for the children, and splitting
+    // would only add nodes (loose) or copies of the items (split). Items piled up in one
+    // spot are split until the nodes reach the minimum size.
+    qsizetype staying{0};
+    qsizetype pushed{0};
+
+    for (const int *handle{begin}; handle != end; handle++) {
+        int mask{childrenFor(box, m_entries[*handle].bounds)};
+        staying += mask == 0 ? 1 : 0;
+        pushed += std::popcount(static_cast<unsigned int>(mask));
+    }
 
-        return;
+    return 4 * staying + pushed <= 2 * (end - begin);
+}
+
+bool QuadTree::splittable(int node) {
+    // whether a full leaf should be split, raising the bar if it should not be, so a node
+    // full of large items is not looked at again on every insertion
+    Node &cur{m_nodes[node]};
+    if (cur.handles.size() < cur.splitAt || cur.box.width() < 2 * m_minNodeSize) {
+        return false;
     }
 
-    // If the node is subdivided, attempt to delete the item from children
-    if (m_topLeft != nullptr) {
-        m_topLeft->deleteItem(item, updateOrder);
-        m_topRight->deleteItem(item, updateOrder);
-        m_bottomLeft->deleteItem(item, updateOrder);
-        m_bottomRight->deleteItem(item, updateOrder);
+    const int *handles{cur.handles.constData()};
+    if (worthSplitting(cur.box, handles, handles + cur.handles.size())) {
+        return true;
     }
+
+    cur.splitAt *= 2;
+    return false;
 }
 
-void QuadTree::clear() {
-    m_items.clear();
+int QuadTree::homeNode(int root, const Bounds &bounds) {
+    // The smallest node which can hold the item. Only the child containing the center
+    // of the item is a candidate, its loose bounds extend far enough to fit any item
+    // up to its own size.
+    int node{root};
+    while (true) {
+        if (m_nodes[node].firstChild == -1) {
+            if (!splittable(node)) {
+                return node;
+            }
+
+            subdivide(node);
+            distribute(node);
+        }
+
+        int child{childFor(node, bounds)};
+        if (!m_nodes[child].looseBounds.contains(bounds)) {
+            return node;
+        }
 
-    if (m_topLeft != nullptr) {
-        m_topLeft->clear();
-        m_topRight->clear();
-        m_bottomRight->clear();
-        m_bottomLeft->clear();
+        node = child;
     }
 }
 
-void QuadTree::reorder(QVector<ItemPtr>& items) const {
-    std::sort(items.begin(), items.end(), [&](auto &firstItem, auto &secondItem) {
-        return m_orderedList->zIndex(firstItem) < m_orderedList->zIndex(secondItem);
-    });
+void QuadTree::distribute(int node) {
+    // moves the items of a freshly subdivided node into the children they fit in
+    int firstChild{m_nodes[node].firstChild};
+
+    for (qsizetype slot{m_nodes[node].handles.size() - 1}; slot >= 0; slot--) {
+        int mask{childrenFor(m_nodes[node].box, m_nodes[node].bounds[slot])};
+        if (mask == 0) {
+            continue;
+        }
+
+        int handle{m_nodes[node].handles[slot]};
+        removeSlot(node, slot);
+
+        for (int quadrant{0}; quadrant < 4; quadrant++) {
+            if ((mask >> quadrant) & 1) {
+                pushSlot(firstChild + quadrant, handle);
+            }
+        }
+    }
 }
 
-void QuadTree::updateItem(std::shared_ptr<Item> item, const QRectF &oldBoundingBox) {
-    expand(item->boundingBox().topLeft());
-    expand(item->boundingBox().topRight());
-    expand(item->boundingBox().bottomRight());
-    expand(item->boundingBox().bottomLeft());
+void QuadTree::bulkLoad(const QVector<std::shared_ptr<Item>> &items, bool updateOrder) {
+    clear();
+
+    std::vector<int> handles{};
+    handles.reserve(items.size());
+
+    for (const std::shared_ptr<Item> &item : items) {
+        if (!m_handles.contains(item.get())) {
+            handles.push_back(acquireEntry(item));
+        }
+    }
+
+    rebuild(handles);
+
+    if (updateOrder) {
+        m_orderedList->clear();
+        for (const std::shared_ptr<Item> &item : items) {
+            m_orderedList->insert(item);
+        }
+    }
+}
+
+void QuadTree::compact() {
+    // move the live entries to the front of the table, so the handles are dense again
+    std::vector<Entry> entries{};
+    entries.reserve(m_handles.size());
+
+    for (Entry &entry : m_entries) {
+        if (entry.item != nullptr) {
+            entry.locations.clear();
+            entries.push_back(std::move(entry));
+        }
+    }
+
+    m_entries = std::move(entries);
+    m_freeEntries = {};
+
+    std::vector<int> handles(m_entries.size());
+    for (int handle{0}; handle < static_cast<int>(m_entries.size()); handle++) {
+        m_handles[m_entries[handle].item.get()] = handle;
+        handles[handle] = handle;
+    }
 
-    update(item, oldBoundingBox, false);
+    rebuild(handles);
+    m_nodes.shrink_to_fit();
 }
 
-void QuadTree::update(std::shared_ptr<Item> item, const QRectF &oldBoundingBox, bool inserted) {
-    if (!m_boundingBox.intersects(oldBoundingBox) &&
-        !m_boundingBox.intersects(item->boundingBox())) {
+bool QuadTree::fragmented() const {
+    qsizetype freeNodes{static_cast<qsizetype>(m_freeBlocks.size() * 4 + m_freeRoots.size())};
+    qsizetype freeEntries{static_cast<qsizetype>(m_freeEntries.size())};
+
+    return freeNodes * 4 > static_cast<qsizetype>(m_nodes.size()) ||
+           freeEntries * 4 > static_cast<qsizetype>(m_entries.size());
+}
+
+void QuadTree::rebuild(std::vector<int> &handles) {
+    m_nodes = {};
+    m_freeBlocks = {};
+    m_freeRoots = {};
+    m_tiles = {};
+    m_nodes.push_back(makeNode(QRectF{}, -1));
+
+    if (m_mode == Mode::Split) {
+        for (int handle : handles) {
+            insert(handle);
+        }
         return;
     }
 
-    if (m_boundingBox.intersects(oldBoundingBox)) {
-        auto it = std::find(m_items.begin(), m_items.end(), item);
-        if (it != m_items.end()) {
-            m_items.erase(it);
+    // group the items by level and tile, then every tile is built on its own
+    struct Key {
+        int level{};
+        qint64 tile{};
+        int handle{};
+    };
+
+    std::vector<Key> keys{};
+    keys.reserve(handles.size());
+
+    for (int handle : handles) {
+        const Bounds &bounds{m_entries[handle].bounds};
+        int level{levelFor(bounds)};
+        if (level == -1) {
+            pushSlot(oversizedNode, handle);
+            continue;
         }
+
+        QPoint tile{tileAt(
+            QPointF{(bounds.left + bounds.right) / 2, (bounds.top + bounds.bottom) / 2}, level)};
+
+        qint64 key{(static_cast<qint64>(tile.y()) << 32) | static_cast<quint32>(tile.x())};
+        keys.push_back(Key{level, key, handle});
     }
 
-    if (!inserted && m_boundingBox.intersects(item->boundingBox())) {
-        if (m_items.size() < m_capacity) {
-            m_items.push_back(item);
-            inserted = true;
-        } else if (m_topLeft == nullptr)
-            subdivide();
+    std::sort(keys.begin(), keys.end(), [](const Key &a, const Key &b) {
+        return a.level != b.level ? a.level < b.level : a.tile < b.tile;
+    });
+
+    for (std::size_t index{0}; index < keys.size(); index++) {
+        handles[index] = keys[index].handle;
+    }
+
+    for (std::size_t begin{0}, end{0}; begin < keys.size(); begin = end) {
+        while (end < keys.size() && keys[end].level == keys[begin].level &&
+               keys[end].tile == keys[begin].tile) {
+            end++;
+        }
+
+        QPoint tile{static_cast<int>(static_cast<quint32>(keys[begin].tile)),
+                    static_cast<int>(keys[begin].tile >> 32)};
+        build(tileRoot(tile, keys[begin].level), handles.data() + begin, handles.data() + end);
+    }
+}
+
+void QuadTree::build(int node, int *begin, int *end) {
+    // Top down construction: the handles are partitioned in place into the ones staying
+    // in this node and the ones going into each of the four children. Every level is
+    // linear in the number of handles, and nodes are only created where items are.
+    if (end - begin <= m_capacity || m_nodes[node].box.width() < 2 * m_minNodeSize ||
+        !worthSplitting(m_nodes[node].box, begin, end)) {
+        for (int *handle{begin}; handle != end; handle++) {
+            pushSlot(node, *handle);
+        }
+
+        // same as if the items had been inserted one by one
+        while (m_nodes[node].splitAt < end - begin) {
+            m_nodes[node].splitAt *= 2;
+        }
+        return;
+    }
+
+    subdivide(node);
+
+    int firstChild{m_nodes[node].firstChild};
+    int *childBegin{std::partition(begin, end, [&](int handle) {
+        const Bounds &bounds{m_entries[handle].bounds};
+        return !m_nodes[childFor(node, bounds)].looseBounds.contains(bounds);
+    })};
+
+    for (int *handle{begin}; handle != childBegin; handle++) {
+        pushSlot(node, *handle);
     }
 
-    if (m_topLeft != nullptr) {
-        m_topLeft->update(item, oldBoundingBox, inserted);
-        m_topRight->update(item, oldBoundingBox, inserted);
-        m_bottomLeft->update(item, oldBoundingBox, inserted);
-        m_bottomRight->update(item, oldBoundingBox, inserted);
+    for (int child{firstChild}; child < firstChild + 4; child++) {
+        int *childEnd{std::partition(childBegin, end, [&](int handle) {
+            return childFor(node, m_entries[handle].bounds) == child;
+        })};
+
+        build(child, childBegin, childEnd);
+        childBegin = childEnd;
     }
 }
 
-void QuadTree::deleteItems(const QRectF &boundingBox) {
-    if (!m_boundingBox.intersects(boundingBox))
+void QuadTree::deleteItem(std::shared_ptr<Item> const item, bool updateOrder) {
+    auto it{m_handles.find(item.get())};
+    if (it == m_handles.end()) {
         return;
+    }
 
-    for (int i = 0; i < m_items.size();) {
-        if (boundingBox.intersects(m_items[i]->boundingBox())) {
-            m_items.erase(m_items.begin() + i);
-            m_orderedList->remove(m_items[i]);
-        } else {
-            i++;
+    int handle{it->second};
+    QVarLengthArray<Location, 1> locations{m_entries[handle].locations};
+
+    erase(handle);
+    releaseEntry(handle);
+
+    for (const Location &location : locations) {
+        collapse(location.node);
+    }
+
+    if (updateOrder)
+        m_orderedList->remove(item);
+}
+
+void QuadTree::erase(int handle) {
+    // the back references point straight at every slot holding the handle
+    auto &locations{m_entries[handle].locations};
+    while (!locations.empty()) {
+        Location location{locations.back()};
+        removeSlot(location.node, location.slot);
+    }
+}
+
+void QuadTree::clear() {
+    m_nodes = {};
+    m_freeBlocks = {};
+    m_freeRoots = {};
+    m_tiles = {};
+    m_nodes.push_back(makeNode(QRectF{}, -1));
+
+    m_entries = {};
+    m_freeEntries = {};
+    m_handles.clear();
+}
+
+void QuadTree::updateItem(std::shared_ptr<Item> item) {
+    auto it{m_handles.find(item.get())};
+    if (it == m_handles.end()) {
+        return;
+    }
+
+    int handle{it->second};
+    QVarLengthArray<Location, 1> locations{m_entries[handle].locations};
+    erase(handle);
+
+    m_entries[handle].bounds = Bounds{item->boundingBox()};
+    insert(handle);
+
+    // the nodes it left may have become (nearly) empty
+    for (const Location &location : locations) {
+        collapse(location.node);
+    }
+}
+
+void QuadTree::search(const Bounds &area, CandidateVisitor visit) const {
+    m_queryStamp++;
+    search(oversizedNode, area, visit);
+
+    for (int level{0}; level < Common::quadTreeTileLevels; level++) {
+        const QHash<QPoint, int> &roots{m_tiles[level]};
+        if (roots.isEmpty()) {
+            continue;
+        }
+
+        // loose tiles reach into their neighbours by half a tile
+        qreal margin{m_mode == Mode::Loose ? tileSize(level) / 2 : 1};
+        QRect tiles{tilesAround(area, margin, level)};
+
+        // when the area covers more tiles than there are, walking the map is cheaper
+        qint64 columns{static_cast<qint64>(tiles.right()) - tiles.left() + 1};
+        qint64 rows{static_cast<qint64>(tiles.bottom()) - tiles.top() + 1};
+
+        if (columns * rows > roots.size()) {
+            for (auto it{roots.cbegin()}; it != roots.cend(); it++) {
+                if (tiles.contains(it.key())) {
+                    search(it.value(), area, visit);
+                }
+            }
+            continue;
+        }
+
+        for (int y{tiles.top()}; y <= tiles.bottom(); y++) {
+            for (int x{tiles.left()}; x <= tiles.right(); x++) {
+                auto it{roots.constFind(QPoint{x, y})};
+                if (it != roots.cend()) {
+                    search(it.value(), area, visit);
+                }
+            }
+        }
+    }
+}
+
+void QuadTree::search(int node, const Bounds &area, CandidateVisitor visit) const {
+    const Node &cur{m_nodes[node]};
+    if (!cur.looseBounds.overlaps(area)) {
+        return;
+    }
+
+    const Bounds *bounds{cur.bounds.constData()};
+    const int *handles{cur.handles.constData()};
+    const qsizetype count{cur.bounds.size()};
+
+    m_lastQuery.nodesVisited++;
+    m_lastQuery.candidatesTested += count;
+
+    for (qsizetype slot{0}; slot < count; slot++) {
+        if (!bounds[slot].overlaps(area)) {
+            continue;
+        }
+
+        // multiple nodes may have a pointer to the same item, skip it if this
+        // query has already seen it
+        const Entry &entry{m_entries[handles[slot]]};
+        if (entry.visitStamp == m_queryStamp) {
+            continue;
         }
+        entry.visitStamp = m_queryStamp;
+
+        visit(entry.item, bounds[slot]);
     }
 
-    if (m_topLeft != nullptr) {
-        m_topLeft->deleteItems(boundingBox);
-        m_topRight->deleteItems(boundingBox);
-        m_bottomRight->deleteItems(boundingBox);
-        m_bottomLeft->deleteItems(boundingBox);
+    // if this node has sub-regions
+    if (cur.firstChild != -1) {
+        for (int child{cur.firstChild}; child < cur.firstChild + 4; child++) {
+            search(child, area, visit);
+        }
     }
 }
 
 QVector<std::shared_ptr<Item>> QuadTree::getAllItems() const {
-    QVector<std::shared_ptr<Item>> curItems{m_items};
-    if (m_topLeft != nullptr) {
-        curItems += m_topLeft->getAllItems();
-        curItems += m_topRight->getAllItems();
-        curItems += m_bottomRight->getAllItems();
-        curItems += m_bottomLeft->getAllItems();
+    // every item has exactly one entry, so nothing is reported twice
+    QVector<std::shared_ptr<Item>> curItems{};
+    curItems.reserve(static_cast<qsizetype>(m_handles.size()));
+
+    for (const Entry &entry : m_entries) {
+        if (entry.item != nullptr) {
+            curItems.push_back(entry.item);
+        }
     }
+
+    // in stacking order, so that saving and loading a file keeps it
+    reorder(curItems);
     return curItems;
 }
 
-const QRectF &QuadTree::boundingBox() const {
-    return m_boundingBox;
+QRectF QuadTree::boundingBox() const {
+    QRectF box{};
+    for (const QHash<QPoint, int> &roots : m_tiles) {
+        for (int root : roots) {
+            box |= m_nodes[root].box;
+        }
+    }
+
+    if (!m_nodes[oversizedNode].handles.isEmpty()) {
+        box |= m_nodes[oversizedNode].looseBounds.toRect();
+    }
+
+    return box;
 };
 
-int QuadTree::size() const {
-    int totalNodes{static_cast<int>(m_items.size())};
+QString QuadTree::name() const {
+    return m_mode == Mode::Loose ? "QuadTree(loose)" : "QuadTree(split)";
+}
 
-    if (m_topLeft != nullptr) {
-        totalNodes += m_topLeft->size();
-        totalNodes += m_topRight->size();
-        totalNodes += m_bottomRight->size();
-        totalNodes += m_bottomLeft->size();
-    }
-    return totalNodes;
+QuadTree::Mode QuadTree::mode() const {
+    return m_mode;
+}
+
+int QuadTree::size() const {
+    return static_cast<int>(m_handles.size());
 }
 
 void QuadTree::draw(QPainter &painter, const QPointF &offset) const {
@@ -229,73 +906,44 @@ void QuadTree::draw(QPainter &painter, const QPointF &offset) const {
 
     QPen pen{Qt::green};
     painter.setPen(pen);
-    painter.drawRect(m_boundingBox.translated(-offset));
-    painter.restore();
-
-    if (m_topLeft != nullptr) {
-        m_topLeft->draw(painter, offset);
-        m_topRight->draw(painter, offset);
-        m_bottomRight->draw(painter, offset);
-        m_bottomLeft->draw(painter, offset);
+    for (int node{0}; node < static_cast<int>(m_nodes.size()); node++) {
+        if (node != oversizedNode && attached(node)) {
+            painter.drawRect(m_nodes[node].box.translated(-offset));
+        }
     }
-}
 
-void QuadTree::expand(const QPointF &point) {
-    // This function grows the quadtree in size recursively if the
-    // point lies outside of it, making it almost infinite!
-    if (m_boundingBox.contains(point))
-        return;
+    painter.restore();
+}
 
-    double treeW{m_boundingBox.width()}, treeH{m_boundingBox.height()};
-    double x{point.x()}, y{point.y()};
-    QPointF topLeftPoint{m_boundingBox.topLeft()}, bottomRightPoint{m_boundingBox.bottomRight()};
+SpatialIndex::Stats QuadTree::stats() const {
+    Stats stats{size()};
 
-    std::unique_ptr<QuadTree> topLeft{
-        std::make_unique<QuadTree>(m_boundingBox, m_capacity, m_orderedList)};
-    std::unique_ptr<QuadTree> topRight{
-        std::make_unique<QuadTree>(m_boundingBox, m_capacity, m_orderedList)};
-    std::unique_ptr<QuadTree> bottomRight{
-        std::make_unique<QuadTree>(m_boundingBox, m_capacity, m_orderedList)};
-    std::unique_ptr<QuadTree> bottomLeft{
-        std::make_unique<QuadTree>(m_boundingBox, m_capacity, m_orderedList)};
-    std::unique_ptr<QuadTree> cur{};
+    // the oversized items hang off their own node next to the tiles
+    if (!m_nodes[oversizedNode].handles.isEmpty()) {
+        addStats(stats, oversizedNode, 0);
+    }
 
-    if (x < topLeftPoint.x() || y < topLeftPoint.y()) {
-        m_boundingBox.adjust(-treeW, -treeH, 0, 0);
+    for (const QHash<QPoint, int> &roots : m_tiles) {
+        for (int root : roots) {
+            addStats(stats, root, 0);
+        }
+    }
 
-        topLeft->m_boundingBox.translate(-treeW, -treeH);
-        topRight->m_boundingBox.translate(0, -treeH);
-        bottomLeft->m_boundingBox.translate(-treeW, 0);
+    return stats;
+}
 
-        cur = std::move(bottomRight);
-    } else if (x > bottomRightPoint.x() || y > bottomRightPoint.y()) {
-        m_boundingBox.adjust(0, 0, treeW, treeH);
+void QuadTree::addStats(Stats &stats, int node, int depth) const {
+    const Node &cur{m_nodes[node]};
 
-        topRight->m_boundingBox.translate(treeW, 0);
-        bottomRight->m_boundingBox.translate(treeW, treeH);
-        bottomLeft->m_boundingBox.translate(0, treeH);
+    stats.nodes++;
+    stats.references += cur.handles.size();
 
-        cur = std::move(topLeft);
+    if (cur.firstChild == -1) {
+        addLeaf(stats, cur.handles.size(), depth);
+        return;
     }
 
-    if (m_topLeft) {
-        cur->m_topLeft = std::move(m_topLeft);
-        cur->m_topRight = std::move(m_topRight);
-        cur->m_bottomRight = std::move(m_bottomRight);
-        cur->m_bottomLeft = std::move(m_bottomLeft);
+    for (int child{cur.firstChild}; child < cur.firstChild + 4; child++) {
+        addStats(stats, child, depth + 1);
     }
-    cur->m_items = std::move(m_items);
-
-    if (topLeft == nullptr)
-        topLeft = std::move(cur);
-    else if (bottomRight == nullptr)
-        bottomRight = std::move(cur);
-
-    m_topLeft = std::move(topLeft);
-    m_topRight = std::move(topRight);
-    m_bottomRight = std::move(bottomRight);
-    m_bottomLeft = std::move(bottomLeft);
-
-    // expand recursively
-    expand(point);
 }
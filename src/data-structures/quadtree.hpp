@@ -18,78 +18,174 @@
 
 #pragma once
 
+#include <QHash>
 #include <QPainter>
+#include <QPoint>
 #include <QRectF>
+#include <QVarLengthArray>
 #include <QVector>
+#include <array>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
+#include "../common/constants.hpp"
 #include "../item/item.hpp"
+#include "bounds.hpp"
+#include "spatialindex.hpp"
 
 class OrderedList;
 
 /*
- * A QuadTree is a tree data structure which divides the space,
- * or in our case, the canvas, into 4 regions recursively.
- * It will be useful here to detect collisions with existing items
- * And redraw only the items necessary which improves performance.
- */
-/*
- * NOTE: This is tightly coupled with the OrderedList data structure present in
- * the same directory and the Item class present in the `item` directory.
+ * Detects which items are in an area, so that collisions can be found and only the
+ * items which are necessary get redrawn.
+ *
+ * The canvas is cut into square tiles of Common::quadTreeTileSize, looked up in a hash
+ * map and only created where there are items. Each tile is the root of a quadtree which
+ * divides it into 4 regions recursively. Items too large for a tile go to the next tile
+ * level, which works the same way with tiles Common::quadTreeLevelFactor times as large.
+ * Only items too large for the coarsest level are kept in a separate oversized node,
+ * which has no box and never has children.
+ *
+ * All nodes live in a single contiguous pool and refer to their children by index.
+ * Every node keeps the cached bounding boxes of its items right next to their handles,
+ * so a query is a tight loop over plain numbers and only calls into an item once its
+ * cached box matches. The cached boxes are refreshed by `updateItem`, which has to be
+ * called whenever an item changes its bounding box.
+ *
+ * There are two ways of placing items in the nodes:
+ *  - Split: an item is pushed into every child it overlaps, unless it is larger than
+ *    the children, in which case it stays in the node instead of being copied into
+ *    most of them.
+ *  - Loose: every node may hold items reaching up to half its size beyond its edges,
+ *    and an item is stored exactly once, in the smallest node which fully contains it.
+ *
+ * A full node is only split when that would at least halve the number of items a query
+ * in it has to look at. A node full of items too large for its children stays a leaf
+ * and is allowed to hold twice as many before it is looked at again.
  */
-class QuadTree {
+class QuadTree : public SpatialIndex {
 public:
-    using ItemPtr = std::shared_ptr<Item>;
+    enum class Mode { Split, Loose };
 
 private:
-    QVector<ItemPtr> m_items{};
-    QRectF m_boundingBox{};
+    // where a handle is stored, lets an entry be removed without searching the tree
+    struct Location {
+        int node{};
+        qsizetype slot{};
+    };
+
+    // every item in the tree gets an entry, nodes refer to it by its index (the handle)
+    struct Entry {
+        ItemPtr item{};
+        Bounds bounds{};
+        QVarLengthArray<Location, 1> locations{};  // exactly one in loose mode
+        mutable quint64 visitStamp{};              // stamp of the last query which saw this entry
+    };
+
+    struct Node {
+        QRectF box{};
+        Bounds looseBounds{};  // the area the items of this node may cover
+        int parent{-1};
+        int firstChild{-1};   // the four children are stored next to each other, -1 if leaf
+        qsizetype splitAt{};  // number of items at which splitting is considered again
+        QVector<Bounds> bounds{};
+        QVector<int> handles{};
+    };
+
+    // holds the items too large for every tile level, it has no box and never has children
+    static constexpr int oversizedNode{0};
+
+    std::vector<Node> m_nodes{};
+    std::vector<int> m_freeBlocks{};  // groups of four children released by collapsing
+    std::vector<int> m_freeRoots{};   // roots of tiles which became empty
+
+    // tile coordinates to root node, for every tile level from the finest to the coarsest
+    std::array<QHash<QPoint, int>, Common::quadTreeTileLevels> m_tiles{};
+    std::vector<Entry> m_entries{};
+    std::vector<int> m_freeEntries{};
+    std::unordered_map<Item *, int> m_handles{};
     int m_capacity{};
-    std::unique_ptr<QuadTree> m_topLeft{nullptr};
-    std::unique_ptr<QuadTree> m_topRight{nullptr};
-    std::unique_ptr<QuadTree> m_bottomRight{nullptr};
-    std::unique_ptr<QuadTree> m_bottomLeft{nullptr};
-    std::shared_ptr<OrderedList> m_orderedList{nullptr};
+    qreal m_minNodeSize{};  // nodes smaller than twice this are never split
+    Mode m_mode{};
+
+    // every query gets a new stamp, which is how items present in multiple nodes
+    // are reported only once without keeping a set of the ones already seen
+    mutable quint64 m_queryStamp{};
 
 public:
-    QuadTree(QRectF region, int capacity);
-    QuadTree(QRectF region, int capacity, std::shared_ptr<OrderedList> orderedList);
+    QuadTree(int capacity, Mode mode = Mode::Loose);
+    QuadTree(int capacity,
+             std::shared_ptr<OrderedList> orderedList,
+             Mode mode = Mode::Loose,
+             qreal minNodeSize = Common::minQuadTreeNodeSize);
 
     ~QuadTree();
 
-    int size() const;
-    void insertItem(ItemPtr item, bool updateOrder = true);
-    void deleteItem(ItemPtr item, bool updateOrder = true);
-    void updateItem(ItemPtr item, const QRectF &oldBoundingBox);
-    void deleteItems(const QRectF &boundingBox);
+    QString name() const override;
+    int size() const override;
+    void insertItem(ItemPtr item, bool updateOrder = true) override;
+    void deleteItem(ItemPtr item, bool updateOrder = true) override;
+    void updateItem(ItemPtr item) override;
 
-    void reorder(QVector<ItemPtr>& items) const;
+    // replaces the contents of the tree, building it in one go from the bounds of all
+    // the items, which is a lot cheaper than inserting them one by one
+    void bulkLoad(const QVector<ItemPtr> &items, bool updateOrder = true) override;
 
-    QVector<ItemPtr> getAllItems() const;
-    void clear();
+    // rebuilds the nodes and the entry table from scratch, dropping all the space
+    // left behind by deletions; meant to be run when the user is idle
+    void compact() override;
+    bool fragmented() const override;
 
-    template <typename Shape, typename QueryCondition>
-    QVector<ItemPtr> queryItems(const Shape &shape, QueryCondition condition) const;
+    QVector<ItemPtr> getAllItems() const override;
+    void clear() override;
 
-    template <typename Shape>
-    QVector<ItemPtr> queryItems(const Shape &shape) const;
+    void draw(QPainter &painter, const QPointF &offset) const override;
+    QRectF boundingBox() const override;
+    Stats stats() const override;
+    Mode mode() const;
 
-    void draw(QPainter &painter, const QPointF &offset) const;
-    const QRectF &boundingBox() const;
+protected:
+    void search(const Bounds &area, CandidateVisitor visit) const override;
 
 private:
-    bool insert(ItemPtr item, bool updateOrder);
-    void update(ItemPtr item, const QRectF &oldBoundingBox, bool inserted);
-
-    template <typename Shape, typename QueryCondition>
-    void query(const Shape &shape,
-               QueryCondition condition,
-               QVector<ItemPtr> &out,
-               std::unordered_map<ItemPtr, bool> &itemAlreadyPushed) const;
-
-    void subdivide();
-    void expand(const QPointF &point);
+    void search(int node, const Bounds &area, CandidateVisitor visit) const;
+
+    void insert(int handle);
+    bool insertSplit(int node, int handle);
+    void erase(int handle);
+
+    int homeNode(int root, const Bounds &bounds);
+    void build(int node, int *begin, int *end);
+    void rebuild(std::vector<int> &handles);
+    void collapse(int node);
+    bool attached(int node) const;
+    void addStats(Stats &stats, int node, int depth) const;
+
+    QPoint tileAt(const QPointF &point, int level) const;
+    QRect tilesAround(const Bounds &bounds, qreal margin, int level) const;
+    int tileRoot(const QPoint &tile, int level);
+    void releaseTile(int root);
+    int levelOf(int root) const;
+    int levelFor(const Bounds &bounds) const;
+    bool fitsTile(const Bounds &bounds, int level) const;
+    int childFor(int node, const Bounds &bounds) const;
+    int childrenFor(const QRectF &box, const Bounds &bounds) const;
+    bool worthSplitting(const QRectF &box, const int *begin, const int *end) const;
+    bool splittable(int node);
+    void distribute(int node);
+
+    void pushSlot(int node, int handle);
+    void removeSlot(int node, qsizetype slot);
+
+    int acquireEntry(ItemPtr item);
+    void releaseEntry(int handle);
+
+    Node makeNode(const QRectF &box, int parent) const;
+    Bounds looseBoundsOf(const QRectF &box) const;
+    void subdivide(int node);
+
+    static qreal tileSize(int level);
+    static std::array<QRectF, 4> quadrants(const QRectF &box);
+    static int quadrantOf(const QRectF &box, const Bounds &bounds);
 };
-
-#include "quadtree.ipp"
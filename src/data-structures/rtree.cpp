@@ -0,0 +1,691 @@
+/*
+ * Drawy - A simple brainstorming tool with an infinite canvas
+ * Copyright (C) 2025 - Prayag Jain <prayagjain2@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rtree.hpp"
+
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <tuple>
+
+#include "../item/item.hpp"
+#include "orderedlist.hpp"
+
+RTree::RTree(int capacity) : RTree{capacity, std::make_shared<OrderedList>()} {
+}
+
+RTree::RTree(int capacity, std::shared_ptr<OrderedList> orderedList)
+    : SpatialIndex{orderedList},
+      m_capacity{std::max(capacity, 4)},
+      m_minimum{std::max(2, std::max(capacity, 4) * 2 / 5)} {
+}
+
+RTree::~RTree() {
+    qDebug() << "Object deleted: RTree";
+}
+
+int RTree::acquireNode(int level, int parent) {
+    int node{};
+    if (m_freeNodes.empty()) {
+        node = static_cast<int>(m_nodes.size());
+        m_nodes.push_back(Node{});
+    } else {
+        node = m_freeNodes.back();
+        m_freeNodes.pop_back();
+        m_nodes[node] = Node{};
+    }
+
+    m_nodes[node].level = level;
+    m_nodes[node].parent = parent;
+    return node;
+}
+
+void RTree::releaseNode(int node) {
+    m_nodes[node] = Node{};
+    m_nodes[node].level = -1;
+    m_freeNodes.push_back(node);
+}
+
+int RTree::acquireEntry(std::shared_ptr<Item> item) {
+    int handle{};
+    if (m_freeEntries.empty()) {
+        handle = static_cast<int>(m_entries.size());
+        m_entries.push_back(Entry{});
+    } else {
+        handle = m_freeEntries.back();
+        m_freeEntries.pop_back();
+    }
+
+    m_entries[handle].bounds = Bounds{item->boundingBox()};
+    m_entries[handle].item = item;
+    m_entries[handle].leaf = -1;
+    m_handles[item.get()] = handle;
+
+    return handle;
+}
+
+void RTree::releaseEntry(int handle) {
+    m_handles.erase(m_entries[handle].item.get());
+    m_entries[handle].item.reset();
+    m_freeEntries.push_back(handle);
+}
+
+void RTree::push(int node, const Bounds &bounds, int child) {
+    Node &cur{m_nodes[node]};
+    cur.box = cur.children.isEmpty() ? bounds : cur.box.united(bounds);
+    cur.bounds.push_back(bounds);
+    cur.children.push_back(child);
+
+    if (cur.level == 0) {
+        m_entries[child].leaf = node;
+    } else {
+        m_nodes[child].parent = node;
+    }
+}
+
+void RTree::removeSlot(int node, qsizetype slot) {
+    // order within a node does not matter, so fill the gap with the last slot
+    Node &cur{m_nodes[node]};
+    qsizetype last{cur.children.size() - 1};
+
+    cur.bounds[slot] = cur.bounds[last];
+    cur.children[slot] = cur.children[last];
+    cur.bounds.pop_back();
+    cur.children.pop_back();
+}
+
+qsizetype RTree::slotOf(int node, int child) const {
+    const Node &cur{m_nodes[node]};
+    return cur.children.indexOf(child);
+}
+
+bool RTree::refit(int node) {
+    // recomputes the box of the node, returns whether the copy in its parent changed
+    Node &cur{m_nodes[node]};
+    cur.box = cur.bounds.isEmpty() ? Bounds{} : cur.bounds.front();
+    for (const Bounds &bounds : cur.bounds) {
+        cur.box = cur.box.united(bounds);
+    }
+
+    if (cur.parent == -1) {
+        return false;
+    }
+
+    Bounds &copy{m_nodes[cur.parent].bounds[slotOf(cur.parent, node)]};
+    if (copy == cur.box) {
+        return false;
+    }
+
+    copy = cur.box;
+    return true;
+}
+
+void RTree::tighten(int node) {
+    while (refit(node)) {
+        node = m_nodes[node].parent;
+    }
+}
+
+void RTree::insertItem(std::shared_ptr<Item> item, bool updateOrder) {
+    if (m_handles.contains(item.get())) {
+        updateItem(item);
+        return;
+    }
+
+    insert(acquireEntry(item));
+
+    if (updateOrder)
+        m_orderedList->insert(item);
+}
+
+void RTree::insert(int handle) {
+    m_reinsertedLevels = 0;
+    insert(Bounds{m_entries[handle].bounds}, handle, 0);
+}
+
+void RTree::insert(const Bounds &bounds, int child, int level) {
+    if (m_root == -1) {
+        m_root = acquireNode(0, -1);
+    }
+
+    int node{chooseSubtree(bounds, level)};
+    push(node, bounds, child);
+    tighten(node);
+
+    if (m_nodes[node].children.size() > m_capacity) {
+        overflow(node);
+    }
+}
+
+int RTree::chooseSubtree(const Bounds &bounds, int level) const {
+    // Going down, the child whose box grows the least is picked. Right above the leaves
+    // it is the one which adds the least overlap with its siblings instead, as that is
+    // what decides how many leaves a query ends up visiting.
+    int node{m_root};
+
+    while (m_nodes[node].level > level) {
+        const Node &cur{m_nodes[node]};
+        const qsizetype count{cur.children.size()};
+
+        qsizetype best{0};
+        qreal bestOverlap{std::numeric_limits<qreal>::max()};
+        qreal bestEnlargement{std::numeric_limits<qreal>::max()};
+        qreal bestArea{std::numeric_limits<qreal>::max()};
+
+        for (qsizetype slot{0}; slot < count; slot++) {
+            const Bounds &box{cur.bounds[slot]};
+            Bounds grown{box.united(bounds)};
+
+            qreal area{box.area()};
+            qreal enlargement{grown.area() - area};
+            qreal overlap{0};
+
+            if (cur.level == 1) {
+                for (qsizetype other{0}; other < count; other++) {
+                    if (other != slot) {
+                        overlap += grown.overlapArea(cur.bounds[other]) -
+                                   box.overlapArea(cur.bounds[other]);
+                    }
+                }
+            }
+
+            if (std::tie(overlap, enlargement, area) <
+                std::tie(bestOverlap, bestEnlargement, bestArea)) {
+                best = slot;
+                bestOverlap = overlap;
+                bestEnlargement = enlargement;
+                bestArea = area;
+            }
+        }
+
+        node = cur.children[best];
+    }
+
+    return node;
+}
+
+void RTree::overflow(int node) {
+    // the first time a level overflows during an insertion some of the children are
+    // reinserted, after that (and always for the root) the node is split
+    quint32 level{1u << m_nodes[node].level};
+
+    if (node != m_root && (m_reinsertedLevels & level) == 0) {
+        m_reinsertedLevels |= level;
+        reinsert(node);
+    } else {
+        split(node);
+    }
+}
+
+void RTree::reinsert(int node) {
+    // The children farthest away from the center of the node are taken out and inserted
+    // again, the closest of them first. They often find a better place, which saves a
+    // split and keeps the boxes from overlapping.
+    struct Child {
+        qreal distance{};
+        Bounds bounds{};
+        int child{};
+    };
+
+    const int level{m_nodes[node].level};
+    const Bounds box{m_nodes[node].box};
+    QPointF center{(box.left + box.right) / 2, (box.top + box.bottom) / 2};
+
+    std::vector<Child> children{};
+    for (qsizetype slot{0}; slot < m_nodes[node].children.size(); slot++) {
+        const Bounds &bounds{m_nodes[node].bounds[slot]};
+        qreal dx{(bounds.left + bounds.right) / 2 - center.x()};
+        qreal dy{(bounds.top + bounds.bottom) / 2 - center.y()};
+
+        children.push_back(Child{dx * dx + dy * dy, bounds, m_nodes[node].children[slot]});
+    }
+
+    std::sort(children.begin(), children.end(), [](const Child &a, const Child &b) {
+        return a.distance > b.distance;
+    });
+
+    const std::size_t removed{static_cast<std::size_t>(std::max(1, m_capacity * 3 / 10))};
+
+    m_nodes[node].bounds.clear();
+    m_nodes[node].children.clear();
+    for (std::size_t index{removed}; index < children.size(); index++) {
+        push(node, children[index].bounds, children[index].child);
+    }
+    tighten(node);
+
+    for (std::size_t index{removed}; index-- > 0;) {
+        insert(children[index].bounds, children[index].child, level);
+    }
+}
+
+void RTree::split(int node) {
+    // The R* split: the axis is the one along which the possible distributions have the
+    // smallest boxes (by perimeter), and along it the distribution with the least
+    // overlap between the two groups wins, then the one with the least area.
+    const QVector<Bounds> bounds{m_nodes[node].bounds};
+    const QVector<int> children{m_nodes[node].children};
+    const int count{static_cast<int>(children.size())};
+    const int level{m_nodes[node].level};
+
+    std::vector<int> order(count);
+    std::vector<Bounds> prefix(count);
+    std::vector<Bounds> suffix(count);
+
+    auto sortBy = [&](bool vertical, bool upper) {
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](int a, int b) {
+            const Bounds &first{bounds[a]};
+            const Bounds &second{bounds[b]};
+            if (vertical) {
+                return upper ? first.bottom < second.bottom : first.top < second.top;
+            }
+            return upper ? first.right < second.right : first.left < second.left;
+        });
+
+        prefix[0] = bounds[order[0]];
+        for (int index{1}; index < count; index++) {
+            prefix[index] = prefix[index - 1].united(bounds[order[index]]);
+        }
+
+        suffix[count - 1] = bounds[order[count - 1]];
+        for (int index{count - 2}; index >= 0; index--) {
+            suffix[index] = suffix[index + 1].united(bounds[order[index]]);
+        }
+    };
+
+    // a distribution puts the first `split` children in one group and the rest in the other
+    bool vertical{false};
+    qreal bestMargin{std::numeric_limits<qreal>::max()};
+
+    for (bool axis : {false, true}) {
+        qreal margin{0};
+        for (bool upper : {false, true}) {
+            sortBy(axis, upper);
+            for (int split{m_minimum}; split <= count - m_minimum; split++) {
+                margin += prefix[split - 1].margin() + suffix[split].margin();
+            }
+        }
+
+        if (margin < bestMargin) {
+            bestMargin = margin;
+            vertical = axis;
+        }
+    }
+
+    std::vector<int> bestOrder{};
+    int bestSplit{m_minimum};
+    qreal bestOverlap{std::numeric_limits<qreal>::max()};
+    qreal bestArea{std::numeric_limits<qreal>::max()};
+
+    for (bool upper : {false, true}) {
+        sortBy(vertical, upper);
+        for (int split{m_minimum}; split <= count - m_minimum; split++) {
+            qreal overlap{prefix[split - 1].overlapArea(suffix[split])};
+            qreal area{prefix[split - 1].area() + suffix[split].area()};
+
+            if (std::tie(overlap, area) < std::tie(bestOverlap, bestArea)) {
+                bestOverlap = overlap;
+                bestArea = area;
+                bestSplit = split;
+                bestOrder = order;
+            }
+        }
+    }
+
+    // this may reallocate the pool, so no references to nodes are held across it
+    int sibling{acquireNode(level, m_nodes[node].parent)};
+
+    m_nodes[node].bounds.clear();
+    m_nodes[node].children.clear();
+    for (int index{0}; index < count; index++) {
+        int slot{bestOrder[index]};
+        push(index < bestSplit ? node : sibling, bounds[slot], children[slot]);
+    }
+
+    if (node == m_root) {
+        m_root = acquireNode(level + 1, -1);
+        push(m_root, m_nodes[node].box, node);
+        push(m_root, m_nodes[sibling].box, sibling);
+        return;
+    }
+
+    int parent{m_nodes[node].parent};
+    m_nodes[parent].bounds[slotOf(parent, node)] = m_nodes[node].box;
+    push(parent, m_nodes[sibling].box, sibling);
+    tighten(parent);
+
+    if (m_nodes[parent].children.size() > m_capacity) {
+        overflow(parent);
+    }
+}
+
+void RTree::deleteItem(std::shared_ptr<Item> const item, bool updateOrder) {
+    auto it{m_handles.find(item.get())};
+    if (it == m_handles.end()) {
+        return;
+    }
+
+    int handle{it->second};
+    erase(handle);
+    releaseEntry(handle);
+
+    if (updateOrder)
+        m_orderedList->remove(item);
+}
+
+void RTree::erase(int handle) {
+    int leaf{m_entries[handle].leaf};
+    removeSlot(leaf, slotOf(leaf, handle));
+    m_entries[handle].leaf = -1;
+
+    condense(leaf);
+}
+
+void RTree::condense(int node) {
+    // Nodes left with too few children are dropped on the way up, and the items below
+    // them are inserted again, which keeps the tree balanced and its nodes well filled.
+    std::vector<int> orphans{};
+
+    while (node != m_root) {
+        int parent{m_nodes[node].parent};
+
+        if (m_nodes[node].children.size() < m_minimum) {
+            removeSlot(parent, slotOf(parent, node));
+            collect(node, orphans);
+        } else {
+            refit(node);
+        }
+
+        node = parent;
+    }
+
+    refit(m_root);
+
+    // a root with a single child is not needed
+    while (m_nodes[m_root].level > 0 && m_nodes[m_root].children.size() == 1) {
+        int child{m_nodes[m_root].children.front()};
+        releaseNode(m_root);
+        m_root = child;
+        m_nodes[m_root].parent = -1;
+    }
+
+    if (m_nodes[m_root].level > 0 && m_nodes[m_root].children.isEmpty()) {
+        releaseNode(m_root);
+        m_root = -1;
+    }
+
+    for (int handle : orphans) {
+        insert(handle);
+    }
+}
+
+void RTree::collect(int node, std::vector<int> &handles) {
+    // gathers the items below the node and releases all the nodes on the way
+    const QVector<int> children{m_nodes[node].children};
+
+    if (m_nodes[node].level == 0) {
+        handles.insert(handles.end(), children.cbegin(), children.cend());
+    } else {
+        for (int child : children) {
+            collect(child, handles);
+        }
+    }
+
+    releaseNode(node);
+}
+
+void RTree::updateItem(std::shared_ptr<Item> item) {
+    auto it{m_handles.find(item.get())};
+    if (it == m_handles.end()) {
+        return;
+    }
+
+    int handle{it->second};
+    Bounds bounds{item->boundingBox()};
+
+    // while it stays inside its leaf, none of the boxes above need to grow
+    int leaf{m_entries[handle].leaf};
+    if (m_nodes[leaf].box.contains(bounds)) {
+        m_entries[handle].bounds = bounds;
+        m_nodes[leaf].bounds[slotOf(leaf, handle)] = bounds;
+        tighten(leaf);
+        return;
+    }
+
+    erase(handle);
+    m_entries[handle].bounds = bounds;
+    insert(handle);
+}
+
+void RTree::bulkLoad(const QVector<std::shared_ptr<Item>> &items, bool updateOrder) {
+    clear();
+
+    std::vector<int> handles{};
+    handles.reserve(items.size());
+
+    for (const std::shared_ptr<Item> &item : items) {
+        if (!m_handles.contains(item.get())) {
+            handles.push_back(acquireEntry(item));
+        }
+    }
+
+    build(handles);
+
+    if (updateOrder) {
+        m_orderedList->clear();
+        for (const std::shared_ptr<Item> &item : items) {
+            m_orderedList->insert(item);
+        }
+    }
+}
+
+void RTree::build(std::vector<int> &handles) {
+    m_nodes = {};
+    m_freeNodes = {};
+    m_root = -1;
+
+    if (handles.empty()) {
+        return;
+    }
+
+    std::vector<int> children{std::move(handles)};
+    for (int level{0}; children.size() > 1 || level == 0; level++) {
+        children = pack(children, level);
+    }
+
+    m_root = children.front();
+}
+
+std::vector<int> RTree::pack(std::vector<int> &children, int level) {
+    // Sort-Tile-Recursive: the children are sorted by x and cut into vertical slices,
+    // every slice is sorted by y and cut into full nodes
+    auto boundsOf = [&](int child) {
+        return level == 0 ? m_entries[child].bounds : m_nodes[child].box;
+    };
+
+    const std::size_t count{children.size()};
+    const std::size_t capacity{static_cast<std::size_t>(m_capacity)};
+    const std::size_t nodes{(count + capacity - 1) / capacity};
+    const std::size_t slices{static_cast<std::size_t>(std::ceil(std::sqrt(nodes)))};
+    const std::size_t sliceSize{slices * capacity};
+
+    std::sort(children.begin(), children.end(), [&](int a, int b) {
+        Bounds first{boundsOf(a)}, second{boundsOf(b)};
+        return first.left + first.right < second.left + second.right;
+    });
+
+    for (std::size_t begin{0}; begin < count; begin += sliceSize) {
+        auto end{children.begin() + std::min(count, begin + sliceSize)};
+        std::sort(children.begin() + begin, end, [&](int a, int b) {
+            Bounds first{boundsOf(a)}, second{boundsOf(b)};
+            return first.top + first.bottom < second.top + second.bottom;
+        });
+    }
+
+    std::vector<int> parents{};
+    parents.reserve(nodes);
+
+    for (std::size_t begin{0}; begin < count; begin += capacity) {
+        int node{acquireNode(level, -1)};
+        for (std::size_t index{begin}; index < std::min(count, begin + capacity); index++) {
+            push(node, boundsOf(children[index]), children[index]);
+        }
+        parents.push_back(node);
+    }
+
+    return parents;
+}
+
+void RTree::compact() {
+    // move the live entries to the front of the table, so the handles are dense again
+    std::vector<Entry> entries{};
+    entries.reserve(m_handles.size());
+
+    for (Entry &entry : m_entries) {
+        if (entry.item != nullptr) {
+            entry.leaf = -1;
+            entries.push_back(std::move(entry));
+        }
+    }
+
+    m_entries = std::move(entries);
+    m_freeEntries = {};
+
+    std::vector<int> handles(m_entries.size());
+    for (int handle{0}; handle < static_cast<int>(m_entries.size()); handle++) {
+        m_handles[m_entries[handle].item.get()] = handle;
+        handles[handle] = handle;
+    }
+
+    build(handles);
+    m_nodes.shrink_to_fit();
+}
+
+bool RTree::fragmented() const {
+    return m_freeNodes.size() * 4 > m_nodes.size() || m_freeEntries.size() * 4 > m_entries.size();
+}
+
+void RTree::search(const Bounds &area, CandidateVisitor visit) const {
+    if (m_root != -1 && m_nodes[m_root].box.overlaps(area)) {
+        search(m_root, area, visit);
+    }
+}
+
+void RTree::search(int node, const Bounds &area, CandidateVisitor visit) const {
+    const Node &cur{m_nodes[node]};
+    const Bounds *bounds{cur.bounds.constData()};
+    const int *children{cur.children.constData()};
+    const qsizetype count{cur.children.size()};
+
+    m_lastQuery.nodesVisited++;
+    if (cur.level == 0) {
+        m_lastQuery.candidatesTested += count;
+    }
+
+    for (qsizetype slot{0}; slot < count; slot++) {
+        if (!bounds[slot].overlaps(area)) {
+            continue;
+        }
+
+        if (cur.level == 0) {
+            visit(m_entries[children[slot]].item, bounds[slot]);
+        } else {
+            search(children[slot], area, visit);
+        }
+    }
+}
+
+QVector<std::shared_ptr<Item>> RTree::getAllItems() const {
+    QVector<std::shared_ptr<Item>> curItems{};
+    curItems.reserve(static_cast<qsizetype>(m_handles.size()));
+
+    for (const Entry &entry : m_entries) {
+        if (entry.item != nullptr) {
+            curItems.push_back(entry.item);
+        }
+    }
+
+    // in stacking order, so that saving and loading a file keeps it
+    reorder(curItems);
+    return curItems;
+}
+
+void RTree::clear() {
+    m_nodes = {};
+    m_freeNodes = {};
+    m_root = -1;
+
+    m_entries = {};
+    m_freeEntries = {};
+    m_handles.clear();
+}
+
+QRectF RTree::boundingBox() const {
+    if (m_root == -1 || m_nodes[m_root].children.isEmpty()) {
+        return QRectF{};
+    }
+    return m_nodes[m_root].box.toRect();
+}
+
+QString RTree::name() const {
+    return "RTree";
+}
+
+int RTree::size() const {
+    return static_cast<int>(m_handles.size());
+}
+
+void RTree::draw(QPainter &painter, const QPointF &offset) const {
+    painter.save();
+
+    QPen pen{Qt::green};
+    painter.setPen(pen);
+    for (const Node &node : m_nodes) {
+        if (node.level >= 0) {
+            painter.drawRect(node.box.toRect().translated(-offset));
+        }
+    }
+
+    painter.restore();
+}
+
+SpatialIndex::Stats RTree::stats() const {
+    Stats stats{size()};
+    stats.references = size();
+
+    if (m_root == -1) {
+        return stats;
+    }
+
+    // the tree is balanced, the depth of a node only depends on its level
+    int height{m_nodes[m_root].level};
+    for (const Node &node : m_nodes) {
+        if (node.level < 0) {
+            continue;
+        }
+
+        stats.nodes++;
+        if (node.level == 0) {
+            addLeaf(stats, node.children.size(), height);
+        }
+    }
+
+    return stats;
+}
@@ -0,0 +1,130 @@
+/*
+ * Drawy - A simple brainstorming tool with an infinite canvas
+ * Copyright (C) 2025 - Prayag Jain <prayagjain2@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QPainter>
+#include <QRectF>
+#include <QVector>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "../item/item.hpp"
+#include "bounds.hpp"
+#include "spatialindex.hpp"
+
+class OrderedList;
+
+/*
+ * An R*-tree: a balanced tree in which every node holds the bounding boxes of up to
+ * `capacity` children, the leaves pointing at the items. Unlike the QuadTree it does not
+ * divide the space into fixed regions, the boxes of the nodes follow the items, which
+ * suits boards with the items spread far apart and very uneven sizes.
+ *
+ * Items are put where they enlarge the boxes (and the overlap between them) the least.
+ * A full node first gives some of its children to the rest of the tree by reinserting
+ * them, and is only split if that did not help, along the axis and position which
+ * leave the least overlap between the two halves.
+ *
+ * Opening a file uses Sort-Tile-Recursive packing instead, which builds every level from
+ * the one below in a single pass.
+ */
+class RTree : public SpatialIndex {
+private:
+    struct Entry {
+        ItemPtr item{};
+        Bounds bounds{};
+        int leaf{-1};
+    };
+
+    struct Node {
+        Bounds box{};
+        int parent{-1};
+        int level{};               // leaves are at level 0, -1 for released nodes
+        QVector<Bounds> bounds{};  // of the children
+        QVector<int> children{};   // nodes, or entry handles in the leaves
+    };
+
+    std::vector<Node> m_nodes{};
+    std::vector<int> m_freeNodes{};
+    std::vector<Entry> m_entries{};
+    std::vector<int> m_freeEntries{};
+    std::unordered_map<Item *, int> m_handles{};
+    int m_root{-1};
+    int m_capacity{};
+    int m_minimum{};  // fewest children a node other than the root may have
+
+    // levels which already had children reinserted during the current insertion, each
+    // level only gets that chance once, after which full nodes are split
+    quint32 m_reinsertedLevels{};
+
+public:
+    RTree(int capacity);
+    RTree(int capacity, std::shared_ptr<OrderedList> orderedList);
+
+    ~RTree();
+
+    QString name() const override;
+    int size() const override;
+    void insertItem(ItemPtr item, bool updateOrder = true) override;
+    void deleteItem(ItemPtr item, bool updateOrder = true) override;
+    void updateItem(ItemPtr item) override;
+    void bulkLoad(const QVector<ItemPtr> &items, bool updateOrder = true) override;
+
+    void compact() override;
+    bool fragmented() const override;
+
+    QVector<ItemPtr> getAllItems() const override;
+    void clear() override;
+
+    void draw(QPainter &painter, const QPointF &offset) const override;
+    QRectF boundingBox() const override;
+    Stats stats() const override;
+
+protected:
+    void search(const Bounds &area, CandidateVisitor visit) const override;
+
+private:
+    void search(int node, const Bounds &area, CandidateVisitor visit) const;
+
+    void insert(int handle);
+    void insert(const Bounds &bounds, int child, int level);
+    void erase(int handle);
+
+    int chooseSubtree(const Bounds &bounds, int level) const;
+    void overflow(int node);
+    void reinsert(int node);
+    void split(int node);
+    void condense(int node);
+
+    void push(int node, const Bounds &bounds, int child);
+    void removeSlot(int node, qsizetype slot);
+    qsizetype slotOf(int node, int child) const;
+    bool refit(int node);
+    void tighten(int node);
+
+    void build(std::vector<int> &handles);
+    std::vector<int> pack(std::vector<int> &children, int level);
+    void collect(int node, std::vector<int> &handles);
+
+    int acquireNode(int level, int parent);
+    void releaseNode(int node);
+    int acquireEntry(ItemPtr item);
+    void releaseEntry(int handle);
+};
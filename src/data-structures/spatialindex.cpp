@@ -0,0 +1,207 @@
+/*
+ * Drawy - A simple brainstorming tool with an infinite canvas
+ * Copyright (C) 2025 - Prayag Jain <prayagjain2@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spatialindex.hpp"
+
+#include <QDebug>
+#include <algorithm>
+
+#include "../common/constants.hpp"
+#include "gridindex.hpp"
+#include "orderedlist.hpp"
+#include "quadtree.hpp"
+#include "rtree.hpp"
+
+SpatialIndex::SpatialIndex(std::shared_ptr<OrderedList> orderedList)
+    : m_orderedList{orderedList} {
+}
+
+SpatialIndex::~SpatialIndex() {
+    qDebug() << "Object deleted: SpatialIndex";
+}
+
+SpatialIndex::Settings SpatialIndex::Settings::fromEnvironment() {
+    // anything which is not a positive number is ignored
+    auto read = [](const char *name) {
+        bool ok{false};
+        qreal value{qEnvironmentVariable(name).toDouble(&ok)};
+        return ok && value > 0 ? value : 0;
+    };
+
+    Settings settings{};
+    settings.capacity = static_cast<int>(read("DRAWY_SPATIAL_INDEX_CAPACITY"));
+    settings.minNodeSize = read("DRAWY_SPATIAL_INDEX_MIN_NODE_SIZE");
+    settings.cellSize = read("DRAWY_SPATIAL_INDEX_CELL_SIZE");
+    return settings;
+}
+
+std::unique_ptr<SpatialIndex> SpatialIndex::create(const QString &name) {
+    return create(name, Settings{});
+}
+
+std::unique_ptr<SpatialIndex> SpatialIndex::create(const QString &name,
+                                                   const Settings &settings) {
+    return create(name, std::make_shared<OrderedList>(), settings);
+}
+
+std::unique_ptr<SpatialIndex> SpatialIndex::create(const QString &name,
+                                                   std::shared_ptr<OrderedList> orderedList,
+                                                   const Settings &settings) {
+    auto valueOr = [](auto value, auto fallback) { return value > 0 ? value : fallback; };
+
+    if (name == "rtree") {
+        int capacity{valueOr(settings.capacity, Common::rTreeNodeCapacity)};
+        return std::make_unique<RTree>(capacity, orderedList);
+    }
+    if (name == "grid") {
+        qreal cellSize{valueOr(settings.cellSize, Common::gridIndexCellSize)};
+        return std::make_unique<GridIndex>(cellSize, orderedList);
+    }
+
+    int capacity{valueOr(settings.capacity, Common::quadTreeCapacity)};
+    qreal minNodeSize{valueOr(settings.minNodeSize, Common::minQuadTreeNodeSize)};
+
+    if (name == "quadtree-split") {
+        return std::make_unique<QuadTree>(
+            capacity, orderedList, QuadTree::Mode::Split, minNodeSize);
+    }
+
+    if (!name.isEmpty() && name != "quadtree") {
+        qWarning() << "Unknown spatial index" << name << "- using the quadtree";
+    }
+    return std::make_unique<QuadTree>(capacity, orderedList, QuadTree::Mode::Loose, minNodeSize);
+}
+
+void SpatialIndex::reorder(QVector<ItemPtr> &items) const {
+    // the z-index lives on the item, so this compares plain integers
+    std::sort(items.begin(), items.end(), [](const auto &firstItem, const auto &secondItem) {
+        return firstItem->zIndex() < secondItem->zIndex();
+    });
+}
+
+OrderedList &SpatialIndex::orderedList() const {
+    return *m_orderedList;
+}
+
+void SpatialIndex::deleteItems(const QRectF &boundingBox) {
+    QVector<std::shared_ptr<Item>> items{
+        queryItems(boundingBox, [](const auto &, const auto &) { return true; })};
+
+    for (const std::shared_ptr<Item> &item : items) {
+        deleteItem(item);
+    }
+}
+
+std::shared_ptr<Item> SpatialIndex::topmostItemAt(const QPointF &point,
+                                                 qreal tolerance,
+                                                 std::optional<Item::Type> type) const {
+    const std::shared_ptr<Item> *topmost{nullptr};
+
+    // keeps track of the best match while the index is searched, nothing is collected
+    beginQuery();
+    search(Bounds{point}.adjusted(tolerance), [&](const ItemPtr &item, const Bounds &bounds) {
+        if (!bounds.adjusted(tolerance).intersects(point)) {
+            return;
+        }
+
+        m_lastQuery.itemsTested++;
+        if (topmost != nullptr && item->zIndex() <= (*topmost)->zIndex()) {
+            return;
+        }
+        if (type.has_value() && item->type() != type.value()) {
+            return;
+        }
+
+        topmost = &item;
+    });
+    endQuery();
+
+    return topmost != nullptr ? *topmost : nullptr;
+}
+
+void SpatialIndex::visitSorted(std::vector<const ItemPtr *> &matches,
+                               ItemVisitor visitor,
+                               Order order) const {
+    std::sort(matches.begin(), matches.end(), [](const ItemPtr *first, const ItemPtr *second) {
+        return (*first)->zIndex() < (*second)->zIndex();
+    });
+
+    if (order == Order::BackToFront) {
+        for (const ItemPtr *item : matches) {
+            if (!visitor(*item)) {
+                break;
+            }
+        }
+    } else {
+        for (auto it{matches.crbegin()}; it != matches.crend(); it++) {
+            if (!visitor(**it)) {
+                break;
+            }
+        }
+    }
+}
+
+qreal SpatialIndex::Stats::duplication() const {
+    return items == 0 ? 1 : static_cast<qreal>(references) / items;
+}
+
+SpatialIndex::QueryCost &SpatialIndex::QueryCost::operator+=(const QueryCost &other) {
+    queries += other.queries;
+    nodesVisited += other.nodesVisited;
+    candidatesTested += other.candidatesTested;
+    itemsTested += other.itemsTested;
+    return *this;
+}
+
+const SpatialIndex::QueryCost &SpatialIndex::lastQueryCost() const {
+    return m_lastQuery;
+}
+
+const SpatialIndex::QueryCost &SpatialIndex::queryCost() const {
+    return m_queryCost;
+}
+
+void SpatialIndex::resetQueryCost() {
+    m_queryCost = QueryCost{};
+}
+
+void SpatialIndex::beginQuery() const {
+    m_lastQuery = QueryCost{1};
+}
+
+void SpatialIndex::endQuery() const {
+    // a visitor may start a query of its own, its cost is added when that one ends
+    m_queryCost += m_lastQuery;
+}
+
+void SpatialIndex::addLeaf(Stats &stats, qsizetype items, int depth) {
+    stats.leaves++;
+    stats.maxDepth = std::max(stats.maxDepth, depth);
+    stats.meanDepth += (depth - stats.meanDepth) / stats.leaves;
+
+    // bucket 0 is for empty leaves, bucket n for 2^(n-1) up to 2^n - 1 items
+    qsizetype bucket{0};
+    while (items >> bucket != 0) {
+        bucket++;
+    }
+
+    if (stats.occupancy.size() <= bucket) {
+        stats.occupancy.resize(bucket + 1);
+    }
+    stats.occupancy[bucket]++;
+}
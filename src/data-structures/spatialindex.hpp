@@ -0,0 +1,198 @@
+/*
+ * Drawy - A simple brainstorming tool with an infinite canvas
+ * Copyright (C) 2025 - Prayag Jain <prayagjain2@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QPainter>
+#include <QPointF>
+#include <QRectF>
+#include <QString>
+#include <QVector>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "../common/utils/functionref.hpp"
+#include "../item/item.hpp"
+#include "bounds.hpp"
+
+class OrderedList;
+
+/*
+ * The interface of the data structures which find the items in an area of the canvas.
+ * There are a few of them, which do better or worse depending on the board: lots of
+ * small strokes close together, or a few shapes spread far apart. Which one is used is
+ * picked when the application starts (see SpatialIndex::create).
+ *
+ * A backend only has to report the items whose cached bounding boxes overlap an area,
+ * every one of them once. Testing against the actual shape of the query, the condition
+ * of the caller and putting the results in z-order is shared by all of them.
+ *
+ * NOTE: Every index is tied to an OrderedList, which keeps the z-order of its items. An
+ * item can only be in one list, so indexes over the same items have to share it.
+ */
+class SpatialIndex {
+public:
+    using ItemPtr = std::shared_ptr<Item>;
+
+    // order in which visitItems hands out the items
+    enum class Order { BackToFront, FrontToBack };
+
+    // called with the items matching a query, returning false stops the query
+    using ItemVisitor = Common::Utils::FunctionRef<bool(const ItemPtr &)>;
+
+    // called by the backends with every item whose cached box overlaps the queried area
+    using CandidateVisitor = Common::Utils::FunctionRef<void(const ItemPtr &, const Bounds &)>;
+
+    // tuning of the backends, zero keeps the defaults from Common
+    struct Settings {
+        int capacity{};       // items per node before it is split, entries per R-tree node
+        qreal minNodeSize{};  // quadtree nodes smaller than twice this are never split
+        qreal cellSize{};     // of the grid
+
+        // from DRAWY_SPATIAL_INDEX_CAPACITY, DRAWY_SPATIAL_INDEX_MIN_NODE_SIZE and
+        // DRAWY_SPATIAL_INDEX_CELL_SIZE
+        static Settings fromEnvironment();
+    };
+
+    // how the index is laid out, to find out why the queries on a board are slow
+    struct Stats {
+        int items{};
+        int nodes{};
+        int leaves{};
+        int maxDepth{};
+        qreal meanDepth{};         // of the leaves
+        qsizetype references{};    // slots holding an item, an item may be in several of them
+        QVector<int> occupancy{};  // number of leaves holding 0, 1, 2-3, 4-7, ... items
+
+        // references per item, how much the items are copied around
+        qreal duplication() const;
+    };
+
+    // the work done by queries; testing cached boxes is cheap, testing items is not
+    struct QueryCost {
+        qint64 queries{};
+        qint64 nodesVisited{};      // nodes or cells whose items were scanned
+        qint64 candidatesTested{};  // cached boxes compared with the queried area
+        qint64 itemsTested{};       // items whose actual shape was tested
+
+        QueryCost &operator+=(const QueryCost &other);
+    };
+
+protected:
+    std::shared_ptr<OrderedList> m_orderedList{nullptr};
+
+    // filled in by the backends while searching
+    mutable QueryCost m_lastQuery{};
+
+private:
+    // items matched by the current query, kept around so queries don't allocate
+    mutable std::vector<const ItemPtr *> m_scratch{};
+
+    // every query since resetQueryCost
+    mutable QueryCost m_queryCost{};
+
+public:
+    SpatialIndex(std::shared_ptr<OrderedList> orderedList);
+    virtual ~SpatialIndex();
+
+    // Makes the index with the given name: "quadtree" (the default), "quadtree-split",
+    // "rtree" or "grid". The application takes it from the DRAWY_SPATIAL_INDEX
+    // environment variable.
+    static std::unique_ptr<SpatialIndex> create(const QString &name);
+    static std::unique_ptr<SpatialIndex> create(const QString &name, const Settings &settings);
+    static std::unique_ptr<SpatialIndex> create(const QString &name,
+                                                std::shared_ptr<OrderedList> orderedList,
+                                                const Settings &settings);
+
+    virtual QString name() const = 0;
+    virtual int size() const = 0;
+
+    virtual void insertItem(ItemPtr item, bool updateOrder = true) = 0;
+    virtual void deleteItem(ItemPtr item, bool updateOrder = true) = 0;
+
+    // has to be called whenever an item changes its bounding box
+    virtual void updateItem(ItemPtr item) = 0;
+    void deleteItems(const QRectF &boundingBox);
+
+    // replaces the contents of the index with the items, built in one go; the z-order is
+    // only replaced as well with updateOrder, otherwise the items have to be in it already
+    virtual void bulkLoad(const QVector<ItemPtr> &items, bool updateOrder = true) = 0;
+
+    // gives back the space left behind by deletions; meant to be run when the user is idle
+    virtual void compact() = 0;
+    virtual bool fragmented() const = 0;
+
+    // in z-order
+    virtual QVector<ItemPtr> getAllItems() const = 0;
+
+    // empties the index, the z-order may be shared and is left to the owner, see orderedList
+    virtual void clear() = 0;
+
+    virtual void draw(QPainter &painter, const QPointF &offset) const = 0;
+    virtual QRectF boundingBox() const = 0;
+
+    // walks the whole index, so it is only meant for debugging and tuning
+    virtual Stats stats() const = 0;
+
+    const QueryCost &lastQueryCost() const;
+    const QueryCost &queryCost() const;
+    void resetQueryCost();
+
+    void reorder(QVector<ItemPtr> &items) const;
+    OrderedList &orderedList() const;
+
+    template <typename Shape, typename QueryCondition>
+    QVector<ItemPtr> queryItems(const Shape &shape, QueryCondition condition) const;
+
+    template <typename Shape>
+    QVector<ItemPtr> queryItems(const Shape &shape) const;
+
+    // Calls `visitor` with every item matching `condition`, in z-order, without building
+    // a list of the results. The visitor can return false to stop the query early, for
+    // example once the item under the cursor has been found. The index must not be
+    // modified from inside the visitor.
+    template <typename Shape, typename QueryCondition, typename Visitor>
+    void visitItems(const Shape &shape,
+                    QueryCondition condition,
+                    Visitor visitor,
+                    Order order = Order::BackToFront) const;
+
+    template <typename Shape, typename Visitor>
+    void visitItems(const Shape &shape, Visitor visitor) const;
+
+    // the topmost item whose bounding box is within `tolerance` of the point, optionally
+    // only considering items of the given type; nothing is sorted, the candidates are
+    // only compared by z-index, so this is what hover and click hit tests should use
+    ItemPtr topmostItemAt(const QPointF &point,
+                          qreal tolerance = 0,
+                          std::optional<Item::Type> type = std::nullopt) const;
+
+protected:
+    // reports every item whose cached box overlaps the area, edges included, exactly once
+    virtual void search(const Bounds &area, CandidateVisitor visit) const = 0;
+
+    static void addLeaf(Stats &stats, qsizetype items, int depth);
+
+private:
+    void beginQuery() const;
+    void endQuery() const;
+    void visitSorted(std::vector<const ItemPtr *> &matches, ItemVisitor visitor, Order order) const;
+};
+
+#include "spatialindex.ipp"
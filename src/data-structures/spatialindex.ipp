@@ -0,0 +1,92 @@
+/*
+ * Drawy - A simple brainstorming tool with an infinite canvas
+ * Copyright (C) 2025 - Prayag Jain <prayagjain2@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <type_traits>
+
+template <typename Shape>
+QVector<std::shared_ptr<Item>> SpatialIndex::queryItems(const Shape &shape) const {
+    return queryItems(shape, [](const std::shared_ptr<Item> &item, const Shape &shape) {
+        return item->intersects(shape);
+    });
+}
+
+template <typename Shape, typename QueryCondition>
+QVector<std::shared_ptr<Item>> SpatialIndex::queryItems(const Shape &shape,
+                                                        QueryCondition condition) const {
+    QVector<std::shared_ptr<Item>> curItems{};
+
+    visitItems(shape, condition, [&](const std::shared_ptr<Item> &item) {
+        curItems.push_back(item);
+    });
+
+    return curItems;
+};
+
+template <typename Shape, typename Visitor>
+void SpatialIndex::visitItems(const Shape &shape, Visitor visitor) const {
+    visitItems(
+        shape,
+        [](const std::shared_ptr<Item> &item, const Shape &shape) {
+            return item->intersects(shape);
+        },
+        visitor);
+}
+
+template <typename Shape, typename QueryCondition, typename Visitor>
+void SpatialIndex::visitItems(const Shape &shape,
+                              QueryCondition condition,
+                              Visitor visitor,
+                              Order order) const {
+    // the visitor may run another query, which then gets a buffer of its own
+    std::vector<const ItemPtr *> matches{std::move(m_scratch)};
+    matches.clear();
+
+    beginQuery();
+    search(Bounds{shape}, [&](const ItemPtr &item, const Bounds &bounds) {
+        // only the cached box here, the actual shapes are tested in z-order below
+        if (bounds.intersects(shape)) {
+            matches.push_back(&item);
+        }
+    });
+
+    // a query started by the visitor replaces the last cost, this one is put back at the end
+    QueryCost cost{m_lastQuery};
+
+    visitSorted(
+        matches,
+        [&](const ItemPtr &item) {
+            // a visitor which stops early also saves the tests of the items behind it
+            cost.itemsTested++;
+            if (!condition(item, shape)) {
+                return true;
+            }
+
+            if constexpr (std::is_void_v<std::invoke_result_t<Visitor &, const ItemPtr &>>) {
+                visitor(item);
+                return true;
+            } else {
+                return static_cast<bool>(visitor(item));
+            }
+        },
+        order);
+
+    m_lastQuery = cost;
+    endQuery();
+
+    m_scratch = std::move(matches);
+}
\ No newline at end of file
@@ -33,6 +33,10 @@ const QRectF Item::boundingBox() const {
     return m_boundingBox.adjusted(-mg, -mg, mg, mg);
 }
 
+qint64 Item::zIndex() const {
+    return m_zIndex;
+}
+
 void Item::setBoundingBoxPadding(int padding) {
     m_boundingBoxPadding = padding;
 }
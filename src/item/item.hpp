@@ -23,6 +23,8 @@
 
 #include "../properties/property.hpp"
 
+class OrderedList;
+
 class Item {
 public:
     Item();
@@ -53,10 +55,18 @@ public:
 
     virtual void updateAfterProperty();
 
+    // position in the stacking order, maintained by the OrderedList holding the item
+    qint64 zIndex() const;
+
 protected:
     QRectF m_boundingBox{};
     int m_boundingBoxPadding{};
     std::unordered_map<Property::Type, Property> m_properties{};
 
     virtual void m_draw(QPainter &painter, const QPointF &offset) const = 0;
+
+private:
+    friend class OrderedList;
+    qint64 m_zIndex{};
+    const OrderedList *m_orderedList{nullptr};  // the one list the item may be in
 };
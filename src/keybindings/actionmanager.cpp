@@ -32,7 +32,7 @@
 #include "../context/spatialcontext.hpp"
 #include "../context/uicontext.hpp"
 #include "../data-structures/cachegrid.hpp"
-#include "../data-structures/quadtree.hpp"
+#include "../data-structures/spatialindex.hpp"
 #include "../serializer/loader.hpp"
 #include "../serializer/serializer.hpp"
 #include "action.hpp"
@@ -138,6 +138,11 @@ ActionManager::ActionManager(ApplicationContext *context) : m_context{context},
                                       [&, context]() { this->loadFromFile(); },
                                       context}};
 
+    Action *debugOverlayAction{new Action{"Toggle Debug Overlay",
+                                          "Show how the spatial index is laid out",
+                                          [&, context]() { this->toggleDebugOverlay(); },
+                                          context}};
+
     keybindManager.addKeybinding(undoAction, "Ctrl+Z");
     keybindManager.addKeybinding(redoAction, "Ctrl+Y");
     keybindManager.addKeybinding(redoAction, "Ctrl+Shift+Z");
@@ -159,6 +164,7 @@ ActionManager::ActionManager(ApplicationContext *context) : m_context{context},
     keybindManager.addKeybinding(openFileAction, "Ctrl+O");
     keybindManager.addKeybinding(groupAction, "Ctrl+G");
     keybindManager.addKeybinding(unGroupAction, "Ctrl+Shift+G");
+    keybindManager.addKeybinding(debugOverlayAction, "Ctrl+Shift+D");
 }
 
 void ActionManager::undo() {
@@ -259,7 +265,7 @@ void ActionManager::deleteSelection() {
 void ActionManager::selectAll() {
     this->switchToSelectionTool();
 
-    auto allItems{m_context->spatialContext().quadtree().getAllItems()};
+    auto allItems{m_context->spatialContext().spatialIndex().getAllItems()};
     m_context->spatialContext().commandHistory().insert(
         std::make_shared<SelectCommand>(allItems)
     );
@@ -281,6 +287,10 @@ void ActionManager::loadFromFile() {
     loader.loadFromFile(m_context);
 }
 
+void ActionManager::toggleDebugOverlay() {
+    m_context->renderingContext().toggleDebugOverlay();
+}
+
 void ActionManager::increaseThickness() {
     // TODO: implement
 }
@@ -47,6 +47,7 @@ public:
     void ungroupItems();
     void saveToFile();
     void loadFromFile();
+    void toggleDebugOverlay();
 
 private:
     ApplicationContext *m_context;
@@ -33,7 +33,7 @@
 #include "../context/renderingcontext.hpp"
 #include "../context/spatialcontext.hpp"
 #include "../data-structures/cachegrid.hpp"
-#include "../data-structures/quadtree.hpp"
+#include "../data-structures/spatialindex.hpp"
 #include "../item/arrow.hpp"
 #include "../item/ellipse.hpp"
 #include "../item/freeform.hpp"
@@ -91,15 +91,23 @@ void Loader::loadFromFile(ApplicationContext *context) {
     QJsonObject docObj = doc.object();
 
     context->reset();
-    QuadTree &quadtree{context->spatialContext().quadtree()};
+    SpatialIndex &spatialIndex{context->spatialContext().spatialIndex()};
 
     QJsonArray itemsArray = array(value(docObj, "items"));
+    QVector<std::shared_ptr<Item>> items{};
+    items.reserve(itemsArray.size());
+
     for (const QJsonValue &v : itemsArray) {
         QJsonObject itemObj = object(v);
         std::shared_ptr<Item> item = createItem(itemObj);
-        quadtree.insertItem(item);
+        if (item != nullptr) {
+            items.push_back(item);
+        }
     }
 
+    // building the whole tree at once is much faster than inserting one by one
+    spatialIndex.bulkLoad(items);
+
     qreal zoomFactor = value(docObj, "zoom_factor").toDouble();
     context->renderingContext().setZoomFactor(zoomFactor);
 
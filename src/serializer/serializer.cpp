@@ -30,7 +30,7 @@
 #include "../context/applicationcontext.hpp"
 #include "../context/renderingcontext.hpp"
 #include "../context/spatialcontext.hpp"
-#include "../data-structures/quadtree.hpp"
+#include "../data-structures/spatialindex.hpp"
 #include "../item/freeform.hpp"
 #include "../item/item.hpp"
 #include "../item/polygon.hpp"
@@ -40,7 +40,7 @@ Serializer::Serializer() {
 }
 
 void Serializer::serialize(ApplicationContext *context) {
-    QVector<std::shared_ptr<Item>> items{context->spatialContext().quadtree().getAllItems()};
+    QVector<std::shared_ptr<Item>> items{context->spatialContext().spatialIndex().getAllItems()};
 
     QJsonArray array{};
     for (auto &item : items) {
@@ -33,7 +33,7 @@
 #include "../context/spatialcontext.hpp"
 #include "../context/uicontext.hpp"
 #include "../data-structures/cachegrid.hpp"
-#include "../data-structures/quadtree.hpp"
+#include "../data-structures/spatialindex.hpp"
 #include "../event/event.hpp"
 #include "../item/item.hpp"
 #include "../properties/widgets/propertymanager.hpp"
@@ -77,34 +77,32 @@ void EraserTool::mouseMoved(ApplicationContext *context) {
     QRectF worldEraserRect{transformer.viewToWorld(curRect)};
 
     if (m_isErasing) {
-        QVector<std::shared_ptr<Item>> toBeErased{
-            spatialContext.quadtree().queryItems(worldEraserRect)};
+        spatialContext.spatialIndex().visitItems(
+            worldEraserRect, [&](const std::shared_ptr<Item> &item) {
+                if (m_toBeErased.count(item) > 0)
+                    return;
 
-        for (std::shared_ptr<Item> item : toBeErased) {
-            if (m_toBeErased.count(item) > 0)
-                continue;
+                item->setProperty(Property::Opacity,
+                                  Property{Common::eraseItemOpacity, Property::Opacity});
 
-            item->setProperty(Property::Opacity,
-                              Property{Common::eraseItemOpacity, Property::Opacity});
-
-            m_toBeErased.insert(item);
-            spatialContext.cacheGrid().markDirty(
-                transformer.worldToGrid(item->boundingBox()).toRect());
-            renderingContext.markForRender();
-        }
+                m_toBeErased.insert(item);
+                spatialContext.cacheGrid().markDirty(
+                    transformer.worldToGrid(item->boundingBox()).toRect());
+                renderingContext.markForRender();
+            });
 
         overlayPainter.fillRect(curRect, Common::eraserBackgroundColor);
     }
 
-    renderingContext.markForUpdate();
-
     // Draw eraser box
     QPen pen{Common::eraserBorderColor, Common::eraserBorderWidth};
     overlayPainter.setPen(pen);
     overlayPainter.drawRect(curRect);
     overlayPainter.restore();
 
-    renderingContext.markForUpdate();
+    // only the old and the new box changed on the overlay
+    renderingContext.markForUpdate((m_lastRect + Common::cleanupMargin).toAlignedRect());
+    renderingContext.markForUpdate((curRect + Common::cleanupMargin).toAlignedRect());
 
     m_lastRect = curRect;
 }
@@ -159,7 +157,8 @@ void EraserTool::cleanup() {
     overlayPainter.setCompositionMode(QPainter::CompositionMode_Source);
     overlayPainter.fillRect(m_lastRect + Common::cleanupMargin, Qt::transparent);
 
-    context->renderingContext().markForUpdate();
+    context->renderingContext().markForUpdate(
+        (m_lastRect + Common::cleanupMargin).toAlignedRect());
 
     overlayPainter.restore();
 }
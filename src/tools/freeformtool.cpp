@@ -21,6 +21,7 @@
 #include "../canvas/canvas.hpp"
 #include "../command/commandhistory.hpp"
 #include "../command/insertitemcommand.hpp"
+#include "../common/constants.hpp"
 #include "../common/renderitems.hpp"
 #include "../context/applicationcontext.hpp"
 #include "../context/coordinatetransformer.hpp"
@@ -112,8 +113,14 @@ void FreeformTool::mouseMoved(ApplicationContext *context) {
         curItem->addPoint(transformer.viewToWorld(curPoint), uiContext.event().pressure());
         curItem->quickDraw(painter, spatialContext.offsetPos());
 
+        // only the segment just drawn changed, padded by the width of its pen
+        qreal strokeWidth{curItem->property(Property::StrokeWidth).value<qreal>()};
+        int pad{static_cast<int>(std::ceil(strokeWidth * renderingContext.zoomFactor()))};
+        QRect segment{QRectF{m_lastPoint, curPoint}.normalized().toAlignedRect()};
+        renderingContext.markForUpdate(segment.adjusted(-pad, -pad, pad, pad) +
+                                       Common::cleanupMargin);
+
         m_lastPoint = curPoint;
-        renderingContext.markForUpdate();
     }
 }
 
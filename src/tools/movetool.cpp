@@ -24,7 +24,7 @@
 #include "../context/renderingcontext.hpp"
 #include "../context/spatialcontext.hpp"
 #include "../context/uicontext.hpp"
-#include "../data-structures/quadtree.hpp"
+#include "../data-structures/spatialindex.hpp"
 #include "../event/event.hpp"
 #include "../item/item.hpp"
 
@@ -23,6 +23,7 @@
 #include "../canvas/canvas.hpp"
 #include "../command/commandhistory.hpp"
 #include "../command/insertitemcommand.hpp"
+#include "../common/constants.hpp"
 #include "../common/renderitems.hpp"
 #include "../context/applicationcontext.hpp"
 #include "../context/coordinatetransformer.hpp"
@@ -77,12 +78,25 @@ void PolygonDrawingTool::mouseMoved(ApplicationContext *context) {
 
         QPainter &overlayPainter{renderingContext.overlayPainter()};
 
+        // what an outline covers in the view, with the pen erasing it ten strokes wide and
+        // arrow heads reaching at most a quarter of the length to the side
+        auto outlineRect = [&]() {
+            QRectF box{QRectF{curItem->start(), curItem->end()}.normalized()};
+            qreal strokeWidth{curItem->property(Property::StrokeWidth).value<qreal>()};
+            qreal pad{5 * strokeWidth + std::hypot(box.width(), box.height()) / 4};
+            box.adjust(-pad, -pad, pad, pad);
+            return transformer.worldToView(box).toAlignedRect() + Common::cleanupMargin;
+        };
+
+        QRect lastRect{outlineRect()};
+
         QPointF offsetPos{spatialContext.offsetPos()};
         curItem->erase(overlayPainter, offsetPos);
         curItem->setEnd(transformer.viewToWorld(uiContext.event().pos()));
         curItem->draw(overlayPainter, offsetPos);
 
-        renderingContext.markForUpdate();
+        renderingContext.markForUpdate(lastRect);
+        renderingContext.markForUpdate(outlineRect());
     }
 };
 
@@ -30,7 +30,7 @@
 #include "../../context/spatialcontext.hpp"
 #include "../../context/uicontext.hpp"
 #include "../../data-structures/cachegrid.hpp"
-#include "../../data-structures/quadtree.hpp"
+#include "../../data-structures/spatialindex.hpp"
 #include "../../event/event.hpp"
 #include "../../item/item.hpp"
 
@@ -70,13 +70,11 @@ void SelectionToolMoveState::mouseMoved(ApplicationContext *context) {
     QPointF delta{worldCurPos - worldLastPos};
 
     for (auto item : selectedItems) {
-        QRectF oldBoundingBox{item->boundingBox()};
-
         spatialContext.cacheGrid().markDirty(transformer.worldToGrid(item->boundingBox()).toRect());
         item->translate(delta);
         spatialContext.cacheGrid().markDirty(transformer.worldToGrid(item->boundingBox()).toRect());
 
-        spatialContext.quadtree().updateItem(item, oldBoundingBox);
+        spatialContext.spatialIndex().updateItem(item);
     }
 
     m_lastPos = curPos;
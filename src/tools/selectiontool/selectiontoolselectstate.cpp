@@ -21,6 +21,7 @@
 #include "../../command/deselectcommand.hpp"
 #include "../../command/commandhistory.hpp"
 #include "../../canvas/canvas.hpp"
+#include "../../common/constants.hpp"
 #include "../../components/propertybar.hpp"
 #include "../../context/applicationcontext.hpp"
 #include "../../context/coordinatetransformer.hpp"
@@ -29,7 +30,7 @@
 #include "../../context/spatialcontext.hpp"
 #include "../../context/uicontext.hpp"
 #include "../../data-structures/cachegrid.hpp"
-#include "../../data-structures/quadtree.hpp"
+#include "../../data-structures/spatialindex.hpp"
 #include "../../event/event.hpp"
 #include "../../item/item.hpp"
 
@@ -45,11 +46,11 @@ bool SelectionToolSelectState::mousePressed(ApplicationContext *context) {
         auto &renderingContext{context->renderingContext()};
         auto &transformer{spatialContext.coordinateTransformer()};
 
-        QVector<std::shared_ptr<Item>> intersectingItems{
-            spatialContext.quadtree().queryItems(transformer.viewToWorld(m_lastPos),
-                                                 [](std::shared_ptr<Item> item, auto &pos) {
-                                                     return item->boundingBox().contains(pos);
-                                                 })};
+        qreal tolerance{
+            transformer.viewToWorld(QSizeF{Common::hitTestTolerance, Common::hitTestTolerance})
+                .width()};
+        std::shared_ptr<Item> hitItem{
+            spatialContext.spatialIndex().topmostItemAt(transformer.viewToWorld(m_lastPos), tolerance)};
 
         bool lockState = true;
         auto &selectedItems{selectionContext.selectedItems()};
@@ -60,10 +61,11 @@ bool SelectionToolSelectState::mousePressed(ApplicationContext *context) {
             commandHistory.insert(std::make_shared<DeselectCommand>(items));
         }
 
-        if (intersectingItems.empty()) {
+        if (hitItem == nullptr) {
             m_isActive = true;
+            m_lastBox = QRect{};
         } else {
-            auto& item{intersectingItems.back()};
+            auto& item{hitItem};
             if ((event.modifiers() & Qt::ShiftModifier) && selectedItems.find(item) != selectedItems.end()) {
                 // deselect the item if selected
                 commandHistory.insert(std::make_shared<DeselectCommand>(QVector<std::shared_ptr<Item>>{item}));
@@ -106,13 +108,13 @@ void SelectionToolSelectState::mouseMoved(ApplicationContext *context) {
     QRectF selectionBox{m_lastPos, curPos};
     QRectF worldSelectionBox{transformer.viewToWorld(selectionBox)};
 
-    QVector<std::shared_ptr<Item>> intersectingItems{
-        spatialContext.quadtree().queryItems(worldSelectionBox,
-                                             [](std::shared_ptr<Item> item, const QRectF &rect) {
-                                                 return rect.contains(item->boundingBox());
-                                             })};
-
-    selectedItems = std::unordered_set(intersectingItems.begin(), intersectingItems.end());
+    selectedItems.clear();
+    spatialContext.spatialIndex().visitItems(
+        worldSelectionBox,
+        [](const std::shared_ptr<Item> &item, const QRectF &rect) {
+            return rect.contains(item->boundingBox());
+        },
+        [&](const std::shared_ptr<Item> &item) { selectedItems.insert(item); });
     context->uiContext().propertyBar().updateToolProperties();
 
     QPainter &overlayPainter{renderingContext.overlayPainter()};
@@ -127,8 +129,14 @@ void SelectionToolSelectState::mouseMoved(ApplicationContext *context) {
 
     overlayPainter.restore();
 
+    // the overlay only changed where the old and the new box are, the boxes around the
+    // selected items are repainted by the render
+    QRect curBox{selectionBox.normalized().toAlignedRect() + Common::cleanupMargin};
+    renderingContext.markForUpdate(m_lastBox);
+    renderingContext.markForUpdate(curBox);
+    m_lastBox = curBox;
+
     renderingContext.markForRender();
-    renderingContext.markForUpdate();
 }
 
 bool SelectionToolSelectState::mouseReleased(ApplicationContext *context) {
@@ -148,8 +156,9 @@ bool SelectionToolSelectState::mouseReleased(ApplicationContext *context) {
         }
 
         renderingContext.canvas().overlay()->fill(Qt::transparent);
-        renderingContext.markForUpdate();
+        renderingContext.markForUpdate(m_lastBox);
 
+        m_lastBox = QRect{};
         m_isActive = false;
     }
 
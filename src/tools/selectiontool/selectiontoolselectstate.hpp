@@ -19,6 +19,7 @@
 #pragma once
 
 #include <QPointF>
+#include <QRect>
 class Item;
 
 #include "selectiontoolstate.hpp"
@@ -31,4 +32,5 @@ public:
 
 private:
     QPointF m_lastPos;
+    QRect m_lastBox{};
 };
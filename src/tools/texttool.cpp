@@ -32,7 +32,7 @@
 #include "../context/spatialcontext.hpp"
 #include "../context/uicontext.hpp"
 #include "../data-structures/cachegrid.hpp"
-#include "../data-structures/quadtree.hpp"
+#include "../data-structures/spatialindex.hpp"
 #include "../event/event.hpp"
 #include "../item/factory/textfactory.hpp"
 #include "../keybindings/keybindmanager.hpp"
@@ -59,16 +59,13 @@ void TextTool::mousePressed(ApplicationContext *context) {
         SpatialContext &spatialContext{context->spatialContext()};
         CoordinateTransformer &transformer{spatialContext.coordinateTransformer()};
         RenderingContext &renderingContext{context->renderingContext()};
-        QuadTree &quadTree{spatialContext.quadtree()};
+        SpatialIndex &spatialIndex{spatialContext.spatialIndex()};
         CommandHistory &commandHistory{spatialContext.commandHistory()};
 
         QPointF worldPos{transformer.viewToWorld(uiContext.event().pos())};
-        QVector<std::shared_ptr<Item>> intersectingItems{
-            quadTree.queryItems(worldPos, [](std::shared_ptr<Item> item, const QPointF &point) {
-                return item->type() == Item::Text && item->boundingBox().contains(point);
-            })};
+        std::shared_ptr<Item> hitItem{spatialIndex.topmostItemAt(worldPos, 0, Item::Text)};
 
-        if (intersectingItems.empty()) {
+        if (hitItem == nullptr) {
             if (m_curItem == nullptr) {
                 m_curItem = std::dynamic_pointer_cast<TextItem>(m_itemFactory->create());
                 m_curItem->setBoundingBoxPadding(10 * renderingContext.canvas().scale());
@@ -93,7 +90,7 @@ void TextTool::mousePressed(ApplicationContext *context) {
                     transformer.worldToGrid(m_curItem->boundingBox()).toRect());
             }
 
-            m_curItem = std::dynamic_pointer_cast<TextItem>(intersectingItems.back());
+            m_curItem = std::dynamic_pointer_cast<TextItem>(hitItem);
             m_curItem->setCaret(worldPos);
 
             spatialContext.cacheGrid().markDirty(
@@ -124,16 +121,11 @@ void TextTool::mouseMoved(ApplicationContext *context) {
     CoordinateTransformer &transformer{spatialContext.coordinateTransformer()};
     RenderingContext &renderingContext{context->renderingContext()};
     UIContext &uiContext{context->uiContext()};
-    QuadTree &quadTree{spatialContext.quadtree()};
+    SpatialIndex &spatialIndex{spatialContext.spatialIndex()};
     m_mouseMoved = true;
 
     QPointF worldPos{transformer.viewToWorld(uiContext.event().pos())};
-    QVector<std::shared_ptr<Item>> intersectingItems{
-        quadTree.queryItems(worldPos, [](std::shared_ptr<Item> item, const QPointF &point) {
-            return item->type() == Item::Text && item->boundingBox().contains(point);
-        })};
-
-    if (!intersectingItems.empty()) {
+    if (spatialIndex.topmostItemAt(worldPos, 0, Item::Text) != nullptr) {
         renderingContext.canvas().setCursor(Qt::IBeamCursor);
     } else {
         renderingContext.canvas().setCursor(Qt::CrossCursor);
@@ -467,8 +459,8 @@ void TextTool::keyPressed(ApplicationContext *context) {
             }
         }
 
-        context->spatialContext().quadtree().deleteItem(m_curItem);
-        context->spatialContext().quadtree().insertItem(m_curItem);
+        context->spatialContext().spatialIndex().deleteItem(m_curItem);
+        context->spatialContext().spatialIndex().insertItem(m_curItem);
 
         context->spatialContext().cacheGrid().markAllDirty();
         context->renderingContext().markForRender();
@@ -488,7 +480,7 @@ void TextTool::cleanup() {
     auto &renderingContext{context->renderingContext()};
     auto &uiContext{context->uiContext()};
     auto &transformer{spatialContext.coordinateTransformer()};
-    auto &quadTree{spatialContext.quadtree()};
+    auto &spatialIndex{spatialContext.spatialIndex()};
 
     m_curItem->setMode(TextItem::NORMAL);
     spatialContext.cacheGrid().markDirty(
@@ -498,7 +490,7 @@ void TextTool::cleanup() {
     uiContext.keybindManager().enable();
 
     if (m_curItem->text().isEmpty()) {
-        quadTree.deleteItem(m_curItem);
+        spatialIndex.deleteItem(m_curItem);
     }
 
     context->selectionContext().selectedItems().clear();